@@ -0,0 +1,140 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+Arena::~Arena()
+{
+    while (_large != nullptr) {
+        LargeBlock* next = _large->next;
+        ::operator delete(_large);
+        _large = next;
+    }
+
+    while (_chunks != nullptr) {
+        Chunk* next = _chunks->next;
+        FreePages(_chunks, _chunks->size);
+        _chunks = next;
+    }
+}
+
+void* Arena::Allocate(size_t size)
+{
+    if (size > MAX_BLOCK_SIZE) {
+        LargeBlock* block = static_cast<LargeBlock*>(
+            ::operator new(sizeof(LargeBlock) + size));
+
+        block->previous = nullptr;
+        block->next = _large;
+
+        if (_large != nullptr) {
+            _large->previous = block;
+        }
+
+        _large = block;
+
+        return block + 1;
+    }
+
+    size_t sizeClass = SizeClass(size);
+
+    if (FreeBlock* block = _free[sizeClass]) {
+        _free[sizeClass] = block->next;
+        return block;
+    }
+
+    size_t blockSize = (sizeClass + 1) * BLOCK_ALIGNMENT;
+
+    if (static_cast<size_t>(_end - _current) < blockSize) {
+        AddChunk();
+    }
+
+    void* result = _current;
+    _current += blockSize;
+
+    return result;
+}
+
+void Arena::Deallocate(void* memory, size_t size)
+{
+    if (size > MAX_BLOCK_SIZE) {
+        LargeBlock* block = static_cast<LargeBlock*>(memory) - 1;
+
+        if (block->previous != nullptr) {
+            block->previous->next = block->next;
+        } else {
+            _large = block->next;
+        }
+
+        if (block->next != nullptr) {
+            block->next->previous = block->previous;
+        }
+
+        ::operator delete(block);
+        return;
+    }
+
+    size_t sizeClass = SizeClass(size);
+    FreeBlock* block = static_cast<FreeBlock*>(memory);
+
+    block->next = _free[sizeClass];
+    _free[sizeClass] = block;
+}
+
+void* Arena::AllocatePages(size_t size)
+{
+#ifdef __linux__
+    if (size >= HUGE_CHUNK_SIZE) {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Only a hint, regular pages are fine if huge ones are unavailable.
+        madvise(memory, size, MADV_HUGEPAGE);
+#endif
+
+        return memory;
+    }
+#endif
+
+    return ::operator new(size);
+}
+
+void Arena::FreePages(void* memory, size_t size)
+{
+#ifdef __linux__
+    if (size >= HUGE_CHUNK_SIZE) {
+        munmap(memory, size);
+        return;
+    }
+#endif
+
+    ::operator delete(memory);
+}
+
+void Arena::AddChunk()
+{
+    // The rest of the current chunk is too small for the block, it is left
+    // unused.
+    size_t size = _nextChunkSize;
+    Chunk* chunk = static_cast<Chunk*>(AllocatePages(size));
+
+    chunk->next = _chunks;
+    chunk->size = size;
+    _chunks = chunk;
+
+    // The header takes one block, so blocks stay aligned.
+    _current = reinterpret_cast<char*>(chunk) + BLOCK_ALIGNMENT;
+    _end = reinterpret_cast<char*>(chunk) + size;
+
+    // Heaps that allocate a lot get bigger chunks, up to huge pages.
+    _nextChunkSize = std::min(size * 2, HUGE_CHUNK_SIZE);
+}
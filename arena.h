@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+
+// Backing store for heap nodes. Memory is bump-allocated from large chunks,
+// so creating a node rarely reaches malloc. Freed blocks go on a free list
+// for their size and are handed out again before the chunk is bumped
+// further. Chunks grow geometrically up to HUGE_CHUNK_SIZE and are kept until
+// the arena is destroyed. Chunks of HUGE_CHUNK_SIZE and more are mapped with
+// huge pages where the platform supports it.
+//
+// Blocks bigger than MAX_BLOCK_SIZE come from operator new directly, behind a
+// header that links them into a list. Destroying the arena frees every block
+// still allocated, so its owner only has to run destructors.
+class Arena {
+public:
+    static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t HUGE_CHUNK_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = 512;
+
+public:
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+
+    ~Arena();
+
+public:
+    Arena& operator=(const Arena&) = delete;
+
+public:
+    void* Allocate(size_t size);
+
+    // The size has to be the one the block was allocated with.
+    void Deallocate(void* memory, size_t size);
+
+    // Memory of at least the size that is not carved into blocks, with huge
+    // pages for large sizes. For regions that are bump-allocated by their
+    // owner, such as the nursery.
+    static void* AllocatePages(size_t size);
+
+    static void FreePages(void* memory, size_t size);
+
+private:
+    static constexpr size_t BLOCK_ALIGNMENT = 16;
+    static constexpr size_t SIZE_CLASSES = MAX_BLOCK_SIZE / BLOCK_ALIGNMENT;
+
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    static_assert(sizeof(Chunk) <= BLOCK_ALIGNMENT);
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct LargeBlock {
+        LargeBlock* previous;
+        LargeBlock* next;
+    };
+
+    static_assert(sizeof(LargeBlock) % BLOCK_ALIGNMENT == 0);
+
+private:
+    static size_t SizeClass(size_t size)
+    {
+        return (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT - 1;
+    }
+
+    void AddChunk();
+
+private:
+    char* _current = nullptr;
+    char* _end = nullptr;
+    Chunk* _chunks = nullptr;
+    size_t _nextChunkSize = MIN_CHUNK_SIZE;
+    FreeBlock* _free[SIZE_CLASSES] = {};
+    LargeBlock* _large = nullptr;
+};
@@ -0,0 +1,388 @@
+// Microbenchmarks of BigInteger operations over operand sizes from one digit
+// to 100k digits. Reports time and heap allocations per operation, as a
+// table or as CSV/JSON to compare two builds.
+//
+//     make microbench
+//     ./bigint_microbench [--format=table|csv|json] [--max-digits=N]
+//                         [--min-time-ms=N] [--kernels=scalar|sse2|avx2]
+//                         [--print-scaling]
+//
+// --print-scaling only measures printing against multiplication from 10k to
+// 160k digits and fails if printing falls behind, see CheckPrintScaling.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../bigint.h"
+#include "../bigint_kernels.h"
+
+namespace {
+
+// Counted by the replaced global operator new below.
+size_t allocations = 0;
+
+template <typename T>
+void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Options {
+    std::string format = "table";
+    size_t maxDigits = 100'000;
+    double minTimeMs = 200;
+    bool printScaling = false;
+};
+
+struct Result {
+    std::string operation;
+    size_t digits;
+    size_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+};
+
+std::mt19937_64 rng(42);
+
+std::string RandomDigits(size_t digits) {
+    std::string value(1, static_cast<char>('1' + rng() % 9));
+
+    while (value.size() < digits) {
+        value.push_back(static_cast<char>('0' + rng() % 10));
+    }
+
+    return value;
+}
+
+// Runs operation in growing batches until minTimeMs has passed. setup runs
+// before every single run and is neither timed nor counted, without it whole
+// batches are timed so that clock reads do not dominate small operations.
+Result Measure(const std::string& operation, size_t digits,
+               const Options& options, const std::function<void()>& run,
+               const std::function<void()>& setup = nullptr) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t iterations = 0;
+    size_t allocated = 0;
+    Clock::duration elapsed{};
+
+    for (size_t batch = 1;
+         std::chrono::duration<double, std::milli>(elapsed).count() <
+         options.minTimeMs;
+         batch *= 2) {
+        if (!setup) {
+            size_t allocationsBefore = allocations;
+            Clock::time_point start = Clock::now();
+
+            for (size_t i = 0; i < batch; ++i) {
+                run();
+            }
+
+            elapsed += Clock::now() - start;
+            allocated += allocations - allocationsBefore;
+            iterations += batch;
+            continue;
+        }
+
+        for (size_t i = 0; i < batch; ++i) {
+            setup();
+
+            size_t allocationsBefore = allocations;
+            Clock::time_point start = Clock::now();
+
+            run();
+
+            elapsed += Clock::now() - start;
+            allocated += allocations - allocationsBefore;
+        }
+
+        iterations += batch;
+    }
+
+    return {
+        operation,
+        digits,
+        iterations,
+        std::chrono::duration<double, std::nano>(elapsed).count() / iterations,
+        static_cast<double>(allocated) / iterations,
+    };
+}
+
+std::vector<Result> RunAll(const Options& options) {
+    std::vector<Result> results;
+
+    for (size_t digits = 1; digits <= options.maxDigits; digits *= 10) {
+        // Divisions take a dividend twice as long as the divisor, all other
+        // operations use operands of the same length.
+        std::string lhsDigits = RandomDigits(digits);
+        std::string rhsDigits = RandomDigits(digits);
+        std::string dividendDigits = lhsDigits + RandomDigits(digits);
+
+        BigInteger lhs(lhsDigits, false);
+        BigInteger rhs(rhsDigits, false);
+        BigInteger dividend(dividendDigits, false);
+
+        // Same length and sign, differing only in the lowest limb, so the
+        // comparison has to look at every limb.
+        BigInteger lhsPlusOne = lhs + BigInteger(1);
+
+        BigInteger result;
+        bool flag = false;
+        std::string text;
+
+        results.push_back(Measure("add", digits, options, [&] {
+            result = lhs + rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure("sub", digits, options, [&] {
+            result = lhs - rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure("mul", digits, options, [&] {
+            result = lhs * rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure("div", digits, options, [&] {
+            result = dividend / rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure("mod", digits, options, [&] {
+            result = dividend % rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure("compare", digits, options, [&] {
+            flag = lhs < lhsPlusOne;
+            DoNotOptimize(flag);
+        }));
+
+        results.push_back(Measure("parse", digits, options, [&] {
+            result = BigInteger(lhsDigits, false);
+            DoNotOptimize(result);
+        }));
+
+        // Value() caches its digits, so every run converts a fresh copy
+        // built by an addition outside of the measurement.
+        BigInteger fresh;
+
+        results.push_back(Measure(
+            "value", digits, options,
+            [&] {
+                text = fresh.Value();
+                DoNotOptimize(text);
+            },
+            [&] { fresh = lhs + BigInteger(); }));
+    }
+
+    return results;
+}
+
+// Converting to decimal splits by powers of ten and divides through
+// reciprocals, so it costs O(M(n) log n) where M is multiplication. Its time
+// relative to a multiplication then only grows with log n, while a quadratic
+// conversion would fall behind by n^0.5 against Toom-3.
+constexpr size_t PRINT_SCALING_MIN_DIGITS = 10'000;
+constexpr size_t PRINT_SCALING_MAX_DIGITS = 160'000;
+constexpr double PRINT_SCALING_LIMIT = 3;
+
+std::vector<Result> RunPrintScaling(const Options& options) {
+    std::vector<Result> results;
+
+    for (size_t digits = PRINT_SCALING_MIN_DIGITS;
+         digits <= PRINT_SCALING_MAX_DIGITS; digits *= 2) {
+        BigInteger lhs(RandomDigits(digits), false);
+        BigInteger rhs(RandomDigits(digits), false);
+
+        BigInteger result;
+        BigInteger fresh;
+        std::string text;
+
+        // The first conversion at a size also computes the powers of ten and
+        // their reciprocals, which are cached afterwards.
+        DoNotOptimize((lhs + BigInteger()).Value());
+
+        results.push_back(Measure("mul", digits, options, [&] {
+            result = lhs * rhs;
+            DoNotOptimize(result);
+        }));
+
+        results.push_back(Measure(
+            "value", digits, options,
+            [&] {
+                text = fresh.Value();
+                DoNotOptimize(text);
+            },
+            [&] { fresh = lhs + BigInteger(); }));
+    }
+
+    return results;
+}
+
+// Returns whether the value/mul ratio grew by at most PRINT_SCALING_LIMIT
+// from the smallest to the biggest size.
+bool CheckPrintScaling(const std::vector<Result>& results) {
+    auto ratio = [&](size_t digits) {
+        double mul = 0;
+        double value = 0;
+
+        for (const Result& result : results) {
+            if (result.digits == digits) {
+                (result.operation == "mul" ? mul : value) = result.nsPerOp;
+            }
+        }
+
+        return value / mul;
+    };
+
+    double growth =
+        ratio(PRINT_SCALING_MAX_DIGITS) / ratio(PRINT_SCALING_MIN_DIGITS);
+    bool passed = growth <= PRINT_SCALING_LIMIT;
+
+    std::fprintf(stderr,
+                 "print scaling: value/mul grew %.2fx from %zu to %zu digits, "
+                 "limit %.2fx: %s\n",
+                 growth, PRINT_SCALING_MIN_DIGITS, PRINT_SCALING_MAX_DIGITS,
+                 PRINT_SCALING_LIMIT, passed ? "ok" : "FAILED");
+
+    return passed;
+}
+
+void Print(const std::vector<Result>& results, const Options& options) {
+    const char* kernels = ActiveLimbKernels().name;
+
+    if (options.format == "csv") {
+        std::printf("operation,digits,iterations,ns_per_op,allocs_per_op,"
+                    "kernels\n");
+
+        for (const Result& result : results) {
+            std::printf("%s,%zu,%zu,%.1f,%.2f,%s\n", result.operation.c_str(),
+                        result.digits, result.iterations, result.nsPerOp,
+                        result.allocationsPerOp, kernels);
+        }
+    } else if (options.format == "json") {
+        std::printf("[\n");
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+
+            std::printf("  {\"operation\": \"%s\", \"digits\": %zu, "
+                        "\"iterations\": %zu, \"ns_per_op\": %.1f, "
+                        "\"allocs_per_op\": %.2f, \"kernels\": \"%s\"}%s\n",
+                        result.operation.c_str(), result.digits,
+                        result.iterations, result.nsPerOp,
+                        result.allocationsPerOp, kernels,
+                        i + 1 < results.size() ? "," : "");
+        }
+
+        std::printf("]\n");
+    } else {
+        std::printf("kernels: %s\n", kernels);
+        std::printf("%-10s %10s %12s %16s %12s\n", "operation", "digits",
+                    "iterations", "ns/op", "allocs/op");
+
+        for (const Result& result : results) {
+            std::printf("%-10s %10zu %12zu %16.1f %12.2f\n",
+                        result.operation.c_str(), result.digits,
+                        result.iterations, result.nsPerOp,
+                        result.allocationsPerOp);
+        }
+    }
+}
+
+Options ParseOptions(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(0, separator);
+        std::string value =
+            separator == std::string::npos ? "" : argument.substr(separator + 1);
+
+        if (name == "--format") {
+            if (value != "table" && value != "csv" && value != "json") {
+                throw std::runtime_error("unknown format " + value);
+            }
+
+            options.format = value;
+        } else if (name == "--max-digits") {
+            options.maxDigits = std::stoul(value);
+        } else if (name == "--min-time-ms") {
+            options.minTimeMs = std::stod(value);
+        } else if (name == "--print-scaling") {
+            options.printScaling = true;
+        } else if (name == "--kernels") {
+            const LimbKernels* selected = nullptr;
+
+            for (const LimbKernels* kernels : AvailableLimbKernels()) {
+                if (value == kernels->name) {
+                    selected = kernels;
+                }
+            }
+
+            if (selected == nullptr) {
+                throw std::runtime_error("kernels " + value +
+                                         " are not available");
+            }
+
+            SetActiveLimbKernels(*selected);
+        } else {
+            throw std::runtime_error("unknown option " + argument);
+        }
+    }
+
+    return options;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    ++allocations;
+
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
+int main(int argc, char** argv) {
+    try {
+        Options options = ParseOptions(argc, argv);
+
+        if (options.printScaling) {
+            std::vector<Result> results = RunPrintScaling(options);
+            Print(results, options);
+            std::fflush(stdout);
+            return CheckPrintScaling(results) ? 0 : 1;
+        }
+
+        Print(RunAll(options), options);
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,305 +1,990 @@
 #include "bigint.h"
 
 #include <algorithm>
+#include <bit>
+#include <deque>
+#include <ostream>
 #include <stdexcept>
 
-BigInteger::BigInteger() : _value("0"), _is_negative(false) {}
+#include "bigint_kernels.h"
 
-BigInteger::BigInteger(int value)
-    : _value(std::to_string(value)), _is_negative(value < 0) {}
+BigInteger::BigInteger() : _is_negative(false) {}
+
+BigInteger::BigInteger(int64_t value) : _is_negative(value < 0) {
+    // Negating in unsigned arithmetic keeps INT64_MIN representable.
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value)
+                                   : static_cast<uint64_t>(value);
+
+    while (magnitude != 0) {
+        _limbs.push_back(static_cast<Limb>(magnitude));
+        magnitude >>= LIMB_BITS;
+    }
+}
 
 BigInteger::BigInteger(const std::string& value, bool is_negative)
-    : _value(value), _is_negative(is_negative) {}
+    : _is_negative(is_negative) {
+    ParseDecimal(value);
+}
 
 BigInteger::BigInteger(std::string&& value, bool is_negative)
-    : _value(std::move(value)), _is_negative(is_negative) {}
+    : _is_negative(is_negative) {
+    ParseDecimal(value);
+}
 
 BigInteger::BigInteger(const BigInteger& other)
-    : _value(other._value), _is_negative(other._is_negative) {}
+    : _limbs(other._limbs),
+      _is_negative(other._is_negative),
+      _decimal(other._decimal) {}
 
 BigInteger::BigInteger(BigInteger&& other)
-    : _value(std::move(other._value)),
-      _is_negative(std::move(other._is_negative)) {}
+    : _limbs(std::move(other._limbs)),
+      _is_negative(std::move(other._is_negative)),
+      _decimal(std::move(other._decimal)) {}
+
+BigInteger::BigInteger(Limbs&& limbs, bool is_negative)
+    : _limbs(std::move(limbs)), _is_negative(is_negative) {
+    Trim(_limbs);
+
+    if (_limbs.empty()) {
+        _is_negative = false;
+    }
+}
 
-BigInteger BigInteger::operator=(BigInteger other) {
-    std::swap(this->_value, other._value);
+BigInteger& BigInteger::operator=(const BigInteger& other) {
+    // Assigning the vector keeps the current buffer if it is big enough.
+    _limbs = other._limbs;
+    _is_negative = other._is_negative;
+    _decimal = other._decimal;
+    return *this;
+}
+
+BigInteger& BigInteger::operator=(BigInteger&& other) {
+    std::swap(this->_limbs, other._limbs);
     std::swap(this->_is_negative, other._is_negative);
+    std::swap(this->_decimal, other._decimal);
     return *this;
 }
 
-BigInteger BigInteger::operator+(const BigInteger& other) const {
-    if (_is_negative == other._is_negative) {
-        std::string result;
-        int remain = 0;
+void BigInteger::ParseDecimal(const std::string& value) {
+    size_t begin = 0;
 
-        for (int i = 0; i < std::max(_value.size(), other._value.size()); ++i) {
-            int lhs = 0;
-            int rhs = 0;
+    // The sign is passed separately, but callers are allowed to keep it in
+    // the string as well.
+    if (!value.empty() && (value[0] == '-' || value[0] == '+')) {
+        begin = 1;
+    }
 
-            if (i < _value.size()) {
-                lhs = _value[_value.size() - 1 - i] - '0';
-            }
+    if (begin == value.size()) {
+        throw std::runtime_error("cannot parse empty biginteger");
+    }
 
-            if (i < other._value.size()) {
-                rhs = other._value[other._value.size() - 1 - i] - '0';
-            }
+    for (size_t i = begin; i < value.size(); ++i) {
+        if (value[i] < '0' || value[i] > '9') {
+            throw std::runtime_error("biginteger contains non-digit: " + value);
+        }
+    }
 
-            int temp = lhs + rhs + remain;
+    _limbs = ParseDecimalMagnitude(value.data() + begin,
+                                   value.data() + value.size());
 
-            result.push_back(static_cast<char>(temp % 10 + '0'));
-            remain = temp / 10;
-        }
+    if (_limbs.empty()) {
+        _is_negative = false;
+    }
+}
 
-        if (remain > 0) {
-            result.push_back(static_cast<char>(remain + '0'));
+BigInteger::Limbs BigInteger::ParseDecimalMagnitude(const char* begin,
+                                                    const char* end) {
+    size_t digits = end - begin;
+
+    if (digits > DECIMAL_SPLIT_DIGITS) {
+        // Split off the biggest block of 9 * 2^level low digits, so that
+        // value = high * 10^(9 * 2^level) + low with both halves converted
+        // recursively and joined by one fast multiplication.
+        size_t level = 0;
+
+        while ((size_t(DECIMAL_CHUNK_DIGITS) << (level + 1)) < digits) {
+            ++level;
         }
 
-        std::reverse(result.begin(), result.end());
+        const char* middle = end - (size_t(DECIMAL_CHUNK_DIGITS) << level);
+
+        Limbs high = ParseDecimalMagnitude(begin, middle);
+        Limbs low = ParseDecimalMagnitude(middle, end);
 
-        return BigInteger(result, _is_negative);
+        return AddMagnitudes(MultiplyMagnitudes(high, PowerOfTen(level)), low);
     }
 
-    if (_is_negative) {
-        return other - BigInteger(_value, false);
+    // The first chunk takes the leftover digits, so that all the others are
+    // exactly DECIMAL_CHUNK_DIGITS long.
+    size_t chunk = digits % DECIMAL_CHUNK_DIGITS;
+
+    if (chunk == 0) {
+        chunk = DECIMAL_CHUNK_DIGITS;
     }
 
-    return *this - BigInteger(other._value, false);
-}
+    Limbs result;
+    result.reserve(digits / DECIMAL_CHUNK_DIGITS + 1);
 
-BigInteger BigInteger::operator-(const BigInteger& other) const {
-    if (other._is_negative) {
-        return BigInteger(other._value, false) + *this;
+    for (const char* i = begin; i < end; i += chunk,
+                     chunk = DECIMAL_CHUNK_DIGITS) {
+        Limb part = 0;
+        Limb multiplier = 1;
+
+        for (const char* j = i; j < i + chunk; ++j) {
+            part = part * 10 + (*j - '0');
+            multiplier *= 10;
+        }
+
+        MultiplyAddLimb(result, multiplier, part);
     }
 
-    if (_is_negative) {
-        return *this + BigInteger(other._value, true);
+    return result;
+}
+
+const BigInteger::Limbs& BigInteger::PowerOfTen(size_t level) {
+    // A deque keeps references to computed powers valid while new ones are
+    // appended.
+    static std::deque<Limbs> powers = { Limbs{ DECIMAL_CHUNK } };
+
+    while (powers.size() <= level) {
+        powers.push_back(MultiplyMagnitudes(powers.back(), powers.back()));
     }
 
-    if (*this < other) {
-        BigInteger result = other - *this;
-        result.Negate();
+    return powers[level];
+}
+
+const BigInteger::Limbs& BigInteger::PowerOfTenReciprocal(size_t level) {
+    static std::deque<Limbs> reciprocals;
 
-        return result;
+    while (reciprocals.size() <= level) {
+        reciprocals.push_back(Reciprocal(PowerOfTen(reciprocals.size())));
     }
 
-    std::string result;
-    int taken = 0;
+    return reciprocals[level];
+}
 
-    for (int i = 0; i < _value.size(); ++i) {
-        int x = _value[_value.size() - 1 - i] - '0' - taken;
-        int y = 0;
+void BigInteger::AppendDecimal(const Limbs& value, int level, bool pad,
+                               std::string& output) {
+    if (level < 0 || value.size() <= DECIMAL_SPLIT_LIMBS) {
+        // Peel off nine decimal digits at a time, least significant first.
+        Limbs magnitude = value;
+        std::vector<Limb> chunks;
 
-        if (i < other._value.size()) {
-            y = other._value[other._value.size() - 1 - i] - '0';
+        while (!magnitude.empty()) {
+            chunks.push_back(DivideByLimb(magnitude, DECIMAL_CHUNK));
         }
 
-        int temp = x - y;
+        std::string digits;
+
+        for (size_t i = chunks.size(); i-- > 0;) {
+            std::string chunk = std::to_string(chunks[i]);
 
-        if (temp < 0) {
-            taken = 1;
-            temp += 10;
-        } else {
-            taken = 0;
+            if (i + 1 != chunks.size()) {
+                digits.append(DECIMAL_CHUNK_DIGITS - chunk.size(), '0');
+            }
+
+            digits += chunk;
         }
 
-        result.push_back(static_cast<char>(temp + '0'));
+        if (pad) {
+            size_t width = size_t(DECIMAL_CHUNK_DIGITS) << (level + 1);
+            output.append(width - digits.size(), '0');
+        }
+
+        output += digits;
+        return;
     }
 
-    while (!result.empty() && result.back() == '0') {
-        result.pop_back();
+    Limbs quotient;
+    Limbs remainder;
+
+    const Limbs& divisor = PowerOfTen(level);
+
+    // The value is below the square of the divisor, so a Barrett division
+    // applies and keeps the whole conversion at the cost of multiplication.
+    // While multiplication is still schoolbook a long division is cheaper.
+    if (divisor.size() < GetMultiplicationThresholds().karatsuba) {
+        DivModMagnitudes(value, divisor, quotient, remainder);
+    } else {
+        DivModByReciprocal(value, divisor, PowerOfTenReciprocal(level),
+                           quotient, remainder);
+    }
+
+    // Leading zeros are only allowed for the lower halves.
+    if (!pad && quotient.empty()) {
+        AppendDecimal(remainder, level - 1, false, output);
+        return;
+    }
+
+    AppendDecimal(quotient, level - 1, pad, output);
+    AppendDecimal(remainder, level - 1, true, output);
+}
+
+bool BigInteger::IsZero() const { return _limbs.empty(); }
+
+bool BigInteger::IsNegative() const { return _is_negative; }
+
+bool BigInteger::FitsInt64() const {
+    if (_limbs.size() > 2) {
+        return false;
     }
 
-    if (result.empty()) {
-        result = "0";
+    uint64_t magnitude = 0;
+
+    for (size_t i = _limbs.size(); i-- > 0;) {
+        magnitude = (magnitude << LIMB_BITS) | _limbs[i];
     }
 
-    std::reverse(result.begin(), result.end());
+    // Two's complement has one more negative value than positive ones.
+    return magnitude <= static_cast<uint64_t>(INT64_MAX) + _is_negative;
+}
+
+int64_t BigInteger::ToInt64() const {
+    uint64_t magnitude = 0;
+
+    for (size_t i = _limbs.size(); i-- > 0;) {
+        magnitude = (magnitude << LIMB_BITS) | _limbs[i];
+    }
 
-    return BigInteger(result, false);
+    return static_cast<int64_t>(_is_negative ? 0 - magnitude : magnitude);
 }
 
-std::string BigInteger::operator*(int k) const {
-    if (!(0 <= k && k <= 10)) {
-        throw std::runtime_error("multiplying biginteger by incorrect k");
+size_t BigInteger::HeapBytes() const {
+    size_t bytes = 0;
+
+    if (_limbs.capacity() > Limbs::INLINE_CAPACITY) {
+        bytes += _limbs.capacity() * sizeof(Limb);
     }
 
-    if (k == 10) {
-        std::string result = _value;
-        result.push_back('0');
-        return result;
+    if (_decimal) {
+        bytes += _decimal->capacity();
     }
 
-    std::string result;
-    int remain = 0;
+    return bytes;
+}
 
-    for (int i = _value.size() - 1; i >= 0; --i) {
-        int x = _value[i] - '0';
-        int temp = x * k + remain;
+void BigInteger::Trim(Limbs& value) {
+    while (!value.empty() && value.back() == 0) {
+        value.pop_back();
+    }
+}
 
-        result.push_back(static_cast<char>(temp % 10 + '0'));
-        remain = temp / 10;
+int BigInteger::CompareMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return lhs.size() < rhs.size() ? -1 : 1;
     }
 
-    if (remain > 0) {
-        result.push_back(static_cast<char>(remain + '0'));
+    return ActiveLimbKernels().compare(lhs.data(), rhs.data(), lhs.size());
+}
+
+BigInteger::Limbs BigInteger::AddMagnitudes(const Limbs& lhs,
+                                            const Limbs& rhs) {
+    const Limbs& longer = lhs.size() >= rhs.size() ? lhs : rhs;
+    const Limbs& shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+
+    Limbs result(longer.size() + 1);
+    DoubleLimb carry = ActiveLimbKernels().add(longer.data(), shorter.data(),
+                                               result.data(), shorter.size());
+
+    for (size_t i = shorter.size(); i < longer.size(); ++i) {
+        DoubleLimb sum = DoubleLimb(longer[i]) + carry;
+        result[i] = static_cast<Limb>(sum);
+        carry = sum >> LIMB_BITS;
     }
 
-    std::reverse(result.begin(), result.end());
+    result[longer.size()] = static_cast<Limb>(carry);
+    Trim(result);
 
     return result;
 }
 
-BigInteger BigInteger::operator*(const BigInteger& other) const {
-    bool is_negative = _is_negative ^ other._is_negative;
-    BigInteger sum;
+BigInteger::Limbs BigInteger::SubtractMagnitudes(const Limbs& lhs,
+                                                 const Limbs& rhs) {
+    Limbs result(lhs.size());
+    Limb borrow = ActiveLimbKernels().subtract(lhs.data(), rhs.data(),
+                                               result.data(), rhs.size());
+
+    for (size_t i = rhs.size(); i < lhs.size(); ++i) {
+        result[i] = lhs[i] - borrow;
+        borrow = borrow != 0 && lhs[i] == 0;
+    }
+
+    Trim(result);
 
-    for (int i = 0; i < other._value.size(); ++i) {
-        int x = other._value[other._value.size() - 1 - i] - '0';
-        std::string temp = *this * x;
+    return result;
+}
+
+void BigInteger::AddMagnitudesInPlace(Limbs& target, const Limbs& value) {
+    if (target.size() < value.size()) {
+        target.resize(value.size());
+    }
+
+    DoubleLimb carry = ActiveLimbKernels().add(target.data(), value.data(),
+                                               target.data(), value.size());
+
+    for (size_t i = value.size(); carry != 0 && i < target.size(); ++i) {
+        DoubleLimb sum = DoubleLimb(target[i]) + carry;
+        target[i] = static_cast<Limb>(sum);
+        carry = sum >> LIMB_BITS;
+    }
+
+    if (carry != 0) {
+        target.push_back(static_cast<Limb>(carry));
+    }
+}
+
+void BigInteger::SubtractMagnitudesInPlace(Limbs& target, const Limbs& value) {
+    Limb borrow = ActiveLimbKernels().subtract(target.data(), value.data(),
+                                               target.data(), value.size());
+
+    for (size_t i = value.size(); borrow != 0 && i < target.size(); ++i) {
+        borrow = target[i] == 0;
+        --target[i];
+    }
+
+    Trim(target);
+}
+
+void BigInteger::SubtractFromMagnitudeInPlace(Limbs& target,
+                                              const Limbs& value) {
+    target.resize(value.size());
+
+    ActiveLimbKernels().subtract(value.data(), target.data(), target.data(),
+                                 value.size());
+
+    Trim(target);
+}
+
+namespace {
+
+BigInteger::MultiplicationThresholds multiplicationThresholds;
+
+}  // namespace
+
+BigInteger::MultiplicationThresholds BigInteger::GetMultiplicationThresholds() {
+    return multiplicationThresholds;
+}
+
+void BigInteger::SetMultiplicationThresholds(
+    MultiplicationThresholds thresholds) {
+    multiplicationThresholds = thresholds;
+}
+
+BigInteger::Limbs BigInteger::Slice(const Limbs& value, size_t begin,
+                                    size_t end) {
+    begin = std::min(begin, value.size());
+    end = std::min(end, value.size());
+
+    Limbs result(value.begin() + begin, value.begin() + end);
+    Trim(result);
+
+    return result;
+}
+
+void BigInteger::AddShifted(Limbs& target, const Limbs& value, size_t shift) {
+    DoubleLimb carry = 0;
+    size_t i = 0;
+
+    for (; i < value.size(); ++i) {
+        DoubleLimb sum = DoubleLimb(target[shift + i]) + value[i] + carry;
+        target[shift + i] = static_cast<Limb>(sum);
+        carry = sum >> LIMB_BITS;
+    }
+
+    for (; carry != 0; ++i) {
+        DoubleLimb sum = DoubleLimb(target[shift + i]) + carry;
+        target[shift + i] = static_cast<Limb>(sum);
+        carry = sum >> LIMB_BITS;
+    }
+}
+
+BigInteger::Limbs BigInteger::MultiplyMagnitudes(const Limbs& lhs,
+                                                 const Limbs& rhs) {
+    if (lhs.empty() || rhs.empty()) {
+        return Limbs();
+    }
+
+    const Limbs& longer = lhs.size() >= rhs.size() ? lhs : rhs;
+    const Limbs& shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+
+    if (shorter.size() < multiplicationThresholds.karatsuba) {
+        return SchoolbookMultiply(longer, shorter);
+    }
+
+    // Both Karatsuba and Toom-3 split operands into equal parts, which only
+    // pays off when the operands have similar sizes.
+    if (2 * shorter.size() <= longer.size()) {
+        return UnbalancedMultiply(longer, shorter);
+    }
+
+    if (shorter.size() < multiplicationThresholds.toom3) {
+        return KaratsubaMultiply(longer, shorter);
+    }
+
+    return Toom3Multiply(longer, shorter);
+}
 
-        for (int j = 0; j < i; ++j) {
-            temp.push_back('0');
+BigInteger::Limbs BigInteger::SchoolbookMultiply(const Limbs& lhs,
+                                                 const Limbs& rhs) {
+    Limbs result(lhs.size() + rhs.size());
+
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        DoubleLimb carry = 0;
+
+        for (size_t j = 0; j < rhs.size(); ++j) {
+            DoubleLimb temp =
+                DoubleLimb(lhs[i]) * rhs[j] + result[i + j] + carry;
+
+            result[i + j] = static_cast<Limb>(temp);
+            carry = temp >> LIMB_BITS;
         }
 
-        sum = sum + BigInteger(temp, false);
+        result[i + rhs.size()] = static_cast<Limb>(carry);
     }
 
-    if (is_negative) {
-        sum.Negate();
+    Trim(result);
+
+    return result;
+}
+
+BigInteger::Limbs BigInteger::UnbalancedMultiply(const Limbs& lhs,
+                                                 const Limbs& rhs) {
+    // Cut the longer operand into pieces as long as the shorter one, so that
+    // every partial product is balanced again.
+    Limbs result(lhs.size() + rhs.size() + 1);
+
+    for (size_t begin = 0; begin < lhs.size(); begin += rhs.size()) {
+        Limbs piece = Slice(lhs, begin, begin + rhs.size());
+
+        AddShifted(result, MultiplyMagnitudes(piece, rhs), begin);
     }
 
-    return sum;
+    Trim(result);
+
+    return result;
 }
 
-BigInteger BigInteger::operator/(const BigInteger& other) const {
-    if (_is_negative == other._is_negative) {
-        BigInteger divisor = BigInteger(other._value, false);
-        std::string buffer;
-        std::string result;
-
-        for (int i = 0; i < _value.size(); ++i) {
-            if (_value[i] == '0' && buffer.empty()) {
-                result.push_back('0');
-                continue;
-            }
+BigInteger::Limbs BigInteger::KaratsubaMultiply(const Limbs& lhs,
+                                                const Limbs& rhs) {
+    // lhs = lhsHigh * B^half + lhsLow, the same for rhs.
+    size_t half = (lhs.size() + 1) / 2;
 
-            buffer.push_back(_value[i]);
+    Limbs lhsLow = Slice(lhs, 0, half);
+    Limbs lhsHigh = Slice(lhs, half, lhs.size());
+    Limbs rhsLow = Slice(rhs, 0, half);
+    Limbs rhsHigh = Slice(rhs, half, rhs.size());
 
-            BigInteger temp(buffer, false);
+    Limbs low = MultiplyMagnitudes(lhsLow, rhsLow);
+    Limbs high = MultiplyMagnitudes(lhsHigh, rhsHigh);
 
-            if (temp < divisor) {
-                if (!result.empty()) {
-                    result.push_back('0');
-                }
+    // (lhsLow + lhsHigh)(rhsLow + rhsHigh) - low - high equals the cross term
+    // lhsLow * rhsHigh + lhsHigh * rhsLow, at the cost of one multiplication.
+    Limbs middle = MultiplyMagnitudes(AddMagnitudes(lhsLow, lhsHigh),
+                                      AddMagnitudes(rhsLow, rhsHigh));
+    middle = SubtractMagnitudes(SubtractMagnitudes(middle, low), high);
 
-                continue;
-            }
+    Limbs result(lhs.size() + rhs.size() + 1);
+
+    AddShifted(result, low, 0);
+    AddShifted(result, middle, half);
+    AddShifted(result, high, 2 * half);
+    Trim(result);
+
+    return result;
+}
+
+BigInteger::Limbs BigInteger::Toom3Multiply(const Limbs& lhs,
+                                            const Limbs& rhs) {
+    // Both operands are treated as polynomials of degree 2 in x = B^part.
+    // Their product has degree 4 and is recovered from its values at
+    // 0, 1, -1, -2 and infinity, which takes 5 multiplications instead of 9.
+    size_t part = (lhs.size() + 2) / 3;
+
+    auto evaluate = [part](const Limbs& value) {
+        BigInteger p0(Slice(value, 0, part), false);
+        BigInteger p1(Slice(value, part, 2 * part), false);
+        BigInteger p2(Slice(value, 2 * part, value.size()), false);
+
+        BigInteger even = p0 + p2;
+        BigInteger atMinusOne = even - p1;
+        BigInteger atMinusTwo = atMinusOne + p2;
+        atMinusTwo = atMinusTwo + atMinusTwo - p0;
+
+        return std::vector<BigInteger>{
+            p0, even + p1, atMinusOne, atMinusTwo, p2,
+        };
+    };
+
+    std::vector<BigInteger> lhsPoints = evaluate(lhs);
+    std::vector<BigInteger> rhsPoints = evaluate(rhs);
+    std::vector<BigInteger> points;
+
+    for (size_t i = 0; i < lhsPoints.size(); ++i) {
+        points.push_back(lhsPoints[i] * rhsPoints[i]);
+    }
+
+    const BigInteger& atZero = points[0];
+    const BigInteger& atOne = points[1];
+    const BigInteger& atMinusOne = points[2];
+    const BigInteger& atMinusTwo = points[3];
+    const BigInteger& atInfinity = points[4];
+
+    // Interpolation sequence by Bodrato, it needs only exact divisions by
+    // 2 and 3.
+    BigInteger c0 = atZero;
+    BigInteger c4 = atInfinity;
+    BigInteger c3 = (atMinusTwo - atOne).DivideExactly(3);
+    BigInteger c1 = (atOne - atMinusOne).DivideExactly(2);
+    BigInteger c2 = atMinusOne - atZero;
+    c3 = (c2 - c3).DivideExactly(2) + atInfinity + atInfinity;
+    c2 = c2 + c1 - c4;
+    c1 = c1 - c3;
+
+    // All coefficients of a product of non-negative polynomials are
+    // non-negative, so only magnitudes have to be added.
+    Limbs result(lhs.size() + rhs.size() + 1);
+
+    AddShifted(result, c0._limbs, 0);
+    AddShifted(result, c1._limbs, part);
+    AddShifted(result, c2._limbs, 2 * part);
+    AddShifted(result, c3._limbs, 3 * part);
+    AddShifted(result, c4._limbs, 4 * part);
+    Trim(result);
+
+    return result;
+}
+
+BigInteger BigInteger::DivideExactly(Limb divisor) const {
+    Limbs quotient = _limbs;
+    DivideByLimb(quotient, divisor);
+
+    return BigInteger(std::move(quotient), _is_negative);
+}
 
-            int toAdd = 0;
+void BigInteger::MultiplyAddLimb(Limbs& value, Limb multiplier, Limb addend) {
+    DoubleLimb carry = addend;
 
-            for (int k = 1; k <= 9; ++k) {
-                if (temp >= BigInteger(divisor * (toAdd + 1), false)) {
-                    ++toAdd;
-                } else {
-                    break;
-                }
+    for (Limb& limb : value) {
+        DoubleLimb temp = DoubleLimb(limb) * multiplier + carry;
+
+        limb = static_cast<Limb>(temp);
+        carry = temp >> LIMB_BITS;
+    }
+
+    if (carry != 0) {
+        value.push_back(static_cast<Limb>(carry));
+    }
+}
+
+BigInteger::Limb BigInteger::DivideByLimb(Limbs& value, Limb divisor) {
+    DoubleLimb remainder = 0;
+
+    for (size_t i = value.size(); i-- > 0;) {
+        DoubleLimb current = (remainder << LIMB_BITS) | value[i];
+
+        value[i] = static_cast<Limb>(current / divisor);
+        remainder = current % divisor;
+    }
+
+    Trim(value);
+
+    return static_cast<Limb>(remainder);
+}
+
+void BigInteger::DivModMagnitudes(const Limbs& lhs, const Limbs& rhs,
+                                  Limbs& quotient, Limbs& remainder) {
+    if (CompareMagnitudes(lhs, rhs) < 0) {
+        quotient.clear();
+        remainder = lhs;
+        return;
+    }
+
+    if (rhs.size() == 1) {
+        quotient = lhs;
+        Limb rest = DivideByLimb(quotient, rhs[0]);
+
+        remainder.clear();
+
+        if (rest != 0) {
+            remainder.push_back(rest);
+        }
+
+        return;
+    }
+
+    // Normalize so that the top limb of the divisor has its highest bit set.
+    // Then the quotient limb estimated from the top two limbs of the running
+    // remainder is at most two greater than the real one.
+    size_t n = rhs.size();
+    size_t m = lhs.size() - n;
+    int shift = std::countl_zero(rhs.back());
+
+    Limbs divisor(n);
+    Limbs rest(lhs.size() + 1);
+
+    for (size_t i = n; i-- > 0;) {
+        divisor[i] = rhs[i] << shift;
+
+        if (shift != 0 && i > 0) {
+            divisor[i] |= rhs[i - 1] >> (LIMB_BITS - shift);
+        }
+    }
+
+    rest[lhs.size()] = shift != 0 ? lhs.back() >> (LIMB_BITS - shift) : 0;
+
+    for (size_t i = lhs.size(); i-- > 0;) {
+        rest[i] = lhs[i] << shift;
+
+        if (shift != 0 && i > 0) {
+            rest[i] |= lhs[i - 1] >> (LIMB_BITS - shift);
+        }
+    }
+
+    quotient.assign(m + 1, 0);
+
+    const DoubleLimb base = DoubleLimb(1) << LIMB_BITS;
+
+    for (size_t j = m + 1; j-- > 0;) {
+        DoubleLimb numerator = (DoubleLimb(rest[j + n]) << LIMB_BITS) |
+                               rest[j + n - 1];
+        DoubleLimb estimate = numerator / divisor[n - 1];
+        DoubleLimb estimateRest = numerator % divisor[n - 1];
+
+        while (estimate >= base ||
+               estimate * divisor[n - 2] >
+                   ((estimateRest << LIMB_BITS) | rest[j + n - 2])) {
+            --estimate;
+            estimateRest += divisor[n - 1];
+
+            if (estimateRest >= base) {
+                break;
             }
+        }
+
+        // Subtract estimate * divisor from the current window.
+        int64_t borrow = 0;
 
-            result.push_back(toAdd + '0');
-            buffer = (temp - BigInteger(divisor * toAdd, false))._value;
+        for (size_t i = 0; i < n; ++i) {
+            DoubleLimb product = estimate * divisor[i];
+            int64_t difference = int64_t(rest[i + j]) - borrow -
+                                 int64_t(product & (base - 1));
 
-            if (buffer == "0") {
-                buffer.clear();
+            rest[i + j] = static_cast<Limb>(difference);
+            borrow = int64_t(product >> LIMB_BITS) - (difference >> LIMB_BITS);
+        }
+
+        int64_t top = int64_t(rest[j + n]) - borrow;
+        rest[j + n] = static_cast<Limb>(top);
+
+        // The estimate was still one too big, add the divisor back.
+        if (top < 0) {
+            --estimate;
+
+            DoubleLimb carry = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                DoubleLimb sum = DoubleLimb(rest[i + j]) + divisor[i] + carry;
+                rest[i + j] = static_cast<Limb>(sum);
+                carry = sum >> LIMB_BITS;
             }
+
+            rest[j + n] += static_cast<Limb>(carry);
         }
 
-        return BigInteger(result, false);
+        quotient[j] = static_cast<Limb>(estimate);
     }
 
-    BigInteger temp =
-        BigInteger(_value, false) / BigInteger(other._value, false) + 1;
+    // Undo the normalization of the remainder.
+    remainder.assign(n, 0);
 
-    temp.Negate();
+    for (size_t i = 0; i < n; ++i) {
+        remainder[i] = rest[i] >> shift;
 
-    return temp;
+        if (shift != 0) {
+            remainder[i] |= rest[i + 1] << (LIMB_BITS - shift);
+        }
+    }
+
+    Trim(quotient);
+    Trim(remainder);
 }
 
-BigInteger BigInteger::operator%(const BigInteger& other) const {
-    return *this - (*this / other) * other;
+BigInteger::Limbs BigInteger::Reciprocal(const Limbs& value) {
+    size_t n = value.size();
+
+    Limbs power(2 * n + 1);
+    power.back() = 1;
+
+    if (n < RECIPROCAL_SPLIT_LIMBS) {
+        Limbs quotient;
+        Limbs remainder;
+
+        DivModMagnitudes(power, value, quotient, remainder);
+        return quotient;
+    }
+
+    // The reciprocal of the top h limbs, shifted into place, is correct to
+    // about h limbs. One Newton step x += x * (B^(2n) - value * x) / B^(2n)
+    // doubles that, which is enough for all but the last few units.
+    size_t h = n / 2 + 2;
+    size_t k = n - h;
+
+    Limbs top = Reciprocal(Slice(value, k, n));
+    Limbs shifted(top.size() + k);
+    AddShifted(shifted, top, k);
+
+    BigInteger x(std::move(shifted), false);
+    BigInteger divisor(Limbs(value), false);
+    BigInteger scale(std::move(power), false);
+
+    BigInteger error = scale - divisor * x;
+    BigInteger step = error * x;
+
+    x += BigInteger(Slice(step._limbs, 2 * n, step._limbs.size()),
+                    step._is_negative);
+
+    // Fix up the units lost to truncation.
+    error = scale - divisor * x;
+
+    while (error.IsNegative()) {
+        x -= BigInteger(1);
+        error += divisor;
+    }
+
+    while (error >= divisor) {
+        x += BigInteger(1);
+        error -= divisor;
+    }
+
+    return std::move(x._limbs);
 }
 
-bool BigInteger::operator<(const BigInteger& other) const {
-    if (*this == other) {
-        return false;
+void BigInteger::DivModByReciprocal(const Limbs& lhs, const Limbs& rhs,
+                                    const Limbs& reciprocal, Limbs& quotient,
+                                    Limbs& remainder) {
+    size_t n = rhs.size();
+
+    // floor(floor(lhs / B^(n-1)) * reciprocal / B^(n+1)) is at most two less
+    // than the quotient.
+    Limbs estimate =
+        MultiplyMagnitudes(Slice(lhs, n - 1, lhs.size()), reciprocal);
+
+    quotient = Slice(estimate, n + 1, estimate.size());
+    remainder = SubtractMagnitudes(lhs, MultiplyMagnitudes(quotient, rhs));
+
+    while (CompareMagnitudes(remainder, rhs) >= 0) {
+        SubtractMagnitudesInPlace(remainder, rhs);
+        AddMagnitudesInPlace(quotient, Limbs{ 1 });
     }
+}
+
+BigInteger BigInteger::operator+(const BigInteger& other) const {
+    if (_is_negative == other._is_negative) {
+        return BigInteger(AddMagnitudes(_limbs, other._limbs), _is_negative);
+    }
+
+    // Signs differ, so the result takes the sign of the bigger magnitude.
+    if (CompareMagnitudes(_limbs, other._limbs) >= 0) {
+        return BigInteger(SubtractMagnitudes(_limbs, other._limbs),
+                          _is_negative);
+    }
+
+    return BigInteger(SubtractMagnitudes(other._limbs, _limbs),
+                      other._is_negative);
+}
 
+BigInteger BigInteger::operator-(const BigInteger& other) const {
     if (_is_negative != other._is_negative) {
-        return _is_negative;
+        return BigInteger(AddMagnitudes(_limbs, other._limbs), _is_negative);
     }
 
-    if (_is_negative) {
-        return BigInteger(_value, false) > BigInteger(other._value, false);
+    if (CompareMagnitudes(_limbs, other._limbs) >= 0) {
+        return BigInteger(SubtractMagnitudes(_limbs, other._limbs),
+                          _is_negative);
     }
 
-    if (_value.size() == other._value.size()) {
-        for (int i = 0; i < _value.size(); ++i) {
-            int x = _value[i] - '0';
-            int y = other._value[i] - '0';
+    return BigInteger(SubtractMagnitudes(other._limbs, _limbs), !_is_negative);
+}
 
-            if (x != y) {
-                return x < y;
-            }
-        }
+void BigInteger::AddInPlace(const Limbs& magnitude, bool is_negative) {
+    _decimal.reset();
+
+    if (_is_negative == is_negative) {
+        AddMagnitudesInPlace(_limbs, magnitude);
+    } else if (CompareMagnitudes(_limbs, magnitude) >= 0) {
+        SubtractMagnitudesInPlace(_limbs, magnitude);
+    } else {
+        // The other magnitude is bigger, so the result takes its sign.
+        SubtractFromMagnitudeInPlace(_limbs, magnitude);
+        _is_negative = is_negative;
     }
 
-    return _value.size() < other._value.size();
+    if (_limbs.empty()) {
+        _is_negative = false;
+    }
 }
 
-bool BigInteger::operator>(const BigInteger& other) const {
-    if (*this == other) {
-        return false;
+BigInteger& BigInteger::operator+=(const BigInteger& other) {
+    if (&other == this) {
+        return MultiplyByWord(2);
     }
 
-    if (_is_negative != other._is_negative) {
-        return !_is_negative;
+    AddInPlace(other._limbs, other._is_negative);
+
+    return *this;
+}
+
+BigInteger& BigInteger::operator-=(const BigInteger& other) {
+    if (&other == this) {
+        *this = BigInteger();
+        return *this;
     }
 
-    if (_is_negative) {
-        return BigInteger(_value, false) < BigInteger(other._value, false);
+    AddInPlace(other._limbs, !other._is_negative);
+
+    return *this;
+}
+
+BigInteger& BigInteger::operator*=(const BigInteger& other) {
+    bool is_negative = _is_negative ^ other._is_negative;
+
+    if (other._limbs.size() == 1) {
+        MultiplyByWord(other._limbs[0]);
+    } else {
+        _limbs = MultiplyMagnitudes(_limbs, other._limbs);
+        _decimal.reset();
     }
 
-    if (_value.size() == other._value.size()) {
-        for (int i = 0; i < _value.size(); ++i) {
-            int x = _value[i] - '0';
-            int y = other._value[i] - '0';
+    _is_negative = is_negative && !_limbs.empty();
 
-            if (x != y) {
-                return x > y;
-            }
-        }
+    return *this;
+}
+
+BigInteger& BigInteger::MultiplyByWord(uint32_t word) {
+    _decimal.reset();
+
+    if (word == 0) {
+        _limbs.clear();
+        _is_negative = false;
+    } else {
+        MultiplyAddLimb(_limbs, word, 0);
+    }
+
+    return *this;
+}
+
+BigInteger BigInteger::operator*(const BigInteger& other) const {
+    return BigInteger(MultiplyMagnitudes(_limbs, other._limbs),
+                      _is_negative ^ other._is_negative);
+}
+
+BigInteger BigInteger::operator/(const BigInteger& other) const {
+    return DivMod(other).first;
+}
+
+BigInteger BigInteger::operator%(const BigInteger& other) const {
+    return DivMod(other).second;
+}
+
+std::pair<BigInteger, BigInteger> BigInteger::DivMod(
+    const BigInteger& other) const {
+    if (other.IsZero()) {
+        throw std::runtime_error("division by zero");
+    }
+
+    Limbs quotient;
+    Limbs remainder;
+
+    DivModMagnitudes(_limbs, other._limbs, quotient, remainder);
+
+    bool is_negative = _is_negative != other._is_negative;
+
+    // Truncated division of operands with different signs has to be moved
+    // one step further from zero to round towards negative infinity.
+    if (is_negative && !remainder.empty()) {
+        MultiplyAddLimb(quotient, 1, 1);
+        remainder = SubtractMagnitudes(other._limbs, remainder);
     }
 
-    return _value.size() > other._value.size();
+    return {
+        BigInteger(std::move(quotient), is_negative),
+        BigInteger(std::move(remainder), other._is_negative),
+    };
+}
+
+int BigInteger::Compare(const BigInteger& other) const {
+    if (_is_negative != other._is_negative) {
+        return _is_negative ? -1 : 1;
+    }
+
+    int comparison = CompareMagnitudes(_limbs, other._limbs);
+
+    return _is_negative ? -comparison : comparison;
+}
+
+bool BigInteger::operator<(const BigInteger& other) const {
+    return Compare(other) < 0;
+}
+
+bool BigInteger::operator>(const BigInteger& other) const {
+    return Compare(other) > 0;
 }
 
 bool BigInteger::operator<=(const BigInteger& other) const {
-    return (*this == other) || (*this < other);
+    return Compare(other) <= 0;
 }
 
 bool BigInteger::operator>=(const BigInteger& other) const {
-    return (*this == other) || (*this > other);
+    return Compare(other) >= 0;
 }
 
 bool BigInteger::operator!=(const BigInteger& other) const {
-    return !(*this == other);
+    return Compare(other) != 0;
 }
 
 bool BigInteger::operator==(const BigInteger& other) const {
-    return this->_value == other._value;
+    return Compare(other) == 0;
 }
 
 std::string BigInteger::Value() const {
-    return (_is_negative ? "-" : "") + _value;
+    return _is_negative ? "-" + Digits() : Digits();
+}
+
+void BigInteger::Print(std::ostream& stream) const {
+    if (_is_negative) {
+        stream << '-';
+    }
+
+    stream << Digits();
 }
 
-void BigInteger::Negate() { _is_negative ^= 1; }
+const std::string& BigInteger::Digits() const {
+    static const std::string zero = "0";
+
+    if (IsZero()) {
+        return zero;
+    }
+
+    if (!_decimal) {
+        // Find the smallest power that is bigger than the value and split by
+        // its square root, see AppendDecimal.
+        int level = 0;
+
+        while (PowerOfTen(level).size() <= _limbs.size()) {
+            ++level;
+        }
+
+        std::string digits;
+        AppendDecimal(_limbs, level - 1, false, digits);
+
+        _decimal = std::make_shared<const std::string>(std::move(digits));
+    }
+
+    return *_decimal;
+}
+
+void BigInteger::Negate() {
+    if (!IsZero()) {
+        _is_negative ^= 1;
+    }
+}
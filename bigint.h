@@ -1,12 +1,32 @@
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "limb_vector.h"
 
 class BigInteger {
+public:
+    // Operand sizes in limbs from which multiplication switches from the
+    // schoolbook algorithm to Karatsuba and from Karatsuba to Toom-3. The
+    // smaller operand decides. Exposed so that they can be tuned per machine.
+    struct MultiplicationThresholds {
+        size_t karatsuba = 40;
+        size_t toom3 = 160;
+    };
+
+    static MultiplicationThresholds GetMultiplicationThresholds();
+
+    static void SetMultiplicationThresholds(MultiplicationThresholds thresholds);
+
 public:
     BigInteger();
 
-    BigInteger(int value);
+    BigInteger(int64_t value);
 
     BigInteger(const std::string& value, bool is_negative);
 
@@ -17,7 +37,9 @@ public:
     BigInteger(BigInteger&& other);
 
 public:
-    BigInteger operator=(BigInteger other);
+    BigInteger& operator=(const BigInteger& other);
+
+    BigInteger& operator=(BigInteger&& other);
 
 public:
     BigInteger operator+(const BigInteger& other) const;
@@ -30,7 +52,27 @@ public:
 
     BigInteger operator%(const BigInteger& other) const;
 
+    // Quotient and remainder of a single division. The quotient is rounded
+    // towards negative infinity and the remainder takes the sign of the
+    // divisor, which is what operator/ and operator% return separately.
+    std::pair<BigInteger, BigInteger> DivMod(const BigInteger& other) const;
+
 public:
+    // Compound operators update the value in place and reuse its buffer
+    // whenever the result fits into it.
+    BigInteger& operator+=(const BigInteger& other);
+
+    BigInteger& operator-=(const BigInteger& other);
+
+    BigInteger& operator*=(const BigInteger& other);
+
+    BigInteger& MultiplyByWord(uint32_t word);
+
+public:
+    // Returns -1, 0 or 1 looking at sign, length and limbs once. All
+    // comparison operators go through it.
+    int Compare(const BigInteger& other) const;
+
     bool operator<(const BigInteger& other) const;
 
     bool operator>(const BigInteger& other) const;
@@ -46,13 +88,139 @@ public:
 public:
     std::string Value() const;
 
+    // Writes the same text as Value(), streaming the cached digits instead of
+    // copying them.
+    void Print(std::ostream& stream) const;
+
     void Negate();
 
+    bool IsZero() const;
+
+    bool IsNegative() const;
+
+    bool FitsInt64() const;
+
+    // Only valid when FitsInt64() holds.
+    int64_t ToInt64() const;
+
+    // Memory owned outside of the object itself: spilled limbs and cached
+    // decimal digits.
+    size_t HeapBytes() const;
+
+private:
+    using Limb = uint32_t;
+    using DoubleLimb = uint64_t;
+    using Limbs = LimbVector;
+
+    static constexpr int LIMB_BITS = 32;
+
+    // Largest power of ten that fits into a limb, used to convert from and to
+    // decimal nine digits at a time.
+    static constexpr Limb DECIMAL_CHUNK = 1'000'000'000;
+    static constexpr int DECIMAL_CHUNK_DIGITS = 9;
+
+    // Below these sizes decimal conversion is done chunk by chunk, above them
+    // numbers are split in halves by powers of ten.
+    static constexpr size_t DECIMAL_SPLIT_LIMBS = 32;
+    static constexpr size_t DECIMAL_SPLIT_DIGITS = 300;
+
+    // Below this size reciprocals come from a long division, above it from a
+    // Newton step on the reciprocal of the top half.
+    static constexpr size_t RECIPROCAL_SPLIT_LIMBS = 32;
+
+private:
+    // Magnitude helpers. All of them work with little-endian limbs without
+    // leading zeros.
+    static int CompareMagnitudes(const Limbs& lhs, const Limbs& rhs);
+
+    static Limbs AddMagnitudes(const Limbs& lhs, const Limbs& rhs);
+
+    // Requires lhs >= rhs.
+    static Limbs SubtractMagnitudes(const Limbs& lhs, const Limbs& rhs);
+
+    static void AddMagnitudesInPlace(Limbs& target, const Limbs& value);
+
+    // target -= value, requires target >= value.
+    static void SubtractMagnitudesInPlace(Limbs& target, const Limbs& value);
+
+    // target = value - target, requires target <= value.
+    static void SubtractFromMagnitudeInPlace(Limbs& target,
+                                             const Limbs& value);
+
+    // Picks the multiplication algorithm based on operand sizes.
+    static Limbs MultiplyMagnitudes(const Limbs& lhs, const Limbs& rhs);
+
+    static Limbs SchoolbookMultiply(const Limbs& lhs, const Limbs& rhs);
+
+    // Requires lhs to be at least twice as long as rhs.
+    static Limbs UnbalancedMultiply(const Limbs& lhs, const Limbs& rhs);
+
+    static Limbs KaratsubaMultiply(const Limbs& lhs, const Limbs& rhs);
+
+    static Limbs Toom3Multiply(const Limbs& lhs, const Limbs& rhs);
+
+    // Adds value shifted left by `shift` limbs to target, which has to be
+    // long enough to hold the sum.
+    static void AddShifted(Limbs& target, const Limbs& value, size_t shift);
+
+    static Limbs Slice(const Limbs& value, size_t begin, size_t end);
+
+    // Knuth's algorithm D, with a shortcut for single-limb divisors.
+    static void DivModMagnitudes(const Limbs& lhs, const Limbs& rhs,
+                                 Limbs& quotient, Limbs& remainder);
+
+    // floor(B^(2n) / value) for an n-limb value, where B = 2^32.
+    static Limbs Reciprocal(const Limbs& value);
+
+    // Barrett division of lhs < B^(2n) by an n-limb rhs, given its
+    // Reciprocal(). Costs a few multiplications instead of a long division.
+    static void DivModByReciprocal(const Limbs& lhs, const Limbs& rhs,
+                                   const Limbs& reciprocal, Limbs& quotient,
+                                   Limbs& remainder);
+
+    // Divides magnitude in place and returns the remainder.
+    static Limb DivideByLimb(Limbs& value, Limb divisor);
+
+    static void MultiplyAddLimb(Limbs& value, Limb multiplier, Limb addend);
+
+    static void Trim(Limbs& value);
+
+    // 10^(9 * 2^level), computed once by repeated squaring.
+    static const Limbs& PowerOfTen(size_t level);
+
+    // Reciprocal(PowerOfTen(level)), also computed once.
+    static const Limbs& PowerOfTenReciprocal(size_t level);
+
+    // Requires [begin, end) to contain only digits.
+    static Limbs ParseDecimalMagnitude(const char* begin, const char* end);
+
+    // Appends the digits of value < PowerOfTen(level + 1). With pad set the
+    // output is left-padded with zeros to exactly 9 * 2^(level + 1) digits.
+    static void AppendDecimal(const Limbs& value, int level, bool pad,
+                              std::string& output);
+
 private:
-    // For 0 <= k < 10
-    std::string operator*(int k) const;
+    BigInteger(Limbs&& limbs, bool is_negative);
+
+    void ParseDecimal(const std::string& value);
+
+    // Adds a value with the given magnitude and sign, so that subtraction
+    // does not have to negate a copy of its operand.
+    void AddInPlace(const Limbs& magnitude, bool is_negative);
+
+    // Requires the division to be exact.
+    BigInteger DivideExactly(Limb divisor) const;
+
+    // Decimal digits of the magnitude, converted on the first call.
+    const std::string& Digits() const;
 
 private:
-    std::string _value;
+    // Magnitude in base 2^32, least significant limb first. Zero has no limbs
+    // and is never negative. Values up to 128 bits need no allocation.
+    Limbs _limbs;
     bool _is_negative;
+
+    // Decimal digits of the magnitude, filled in by the first Digits() call.
+    // Copies share it, and Negate() does not have to drop it.
+    mutable std::shared_ptr<const std::string> _decimal;
 };
@@ -0,0 +1,363 @@
+#include "bigint_kernels.h"
+
+#include <bit>
+
+// The vector kernels are compiled for their instruction sets with target
+// attributes, whatever the baseline of the build is, and only picked when the
+// CPU reports support at run time.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define LIMB_KERNELS_X86
+#endif
+
+namespace {
+
+uint32_t ScalarAdd(const uint32_t* lhs, const uint32_t* rhs, uint32_t* result,
+                   size_t size) {
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t sum = uint64_t(lhs[i]) + rhs[i] + carry;
+        result[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+
+    return static_cast<uint32_t>(carry);
+}
+
+uint32_t ScalarSubtract(const uint32_t* lhs, const uint32_t* rhs,
+                        uint32_t* result, size_t size) {
+    uint32_t borrow = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t subtrahend = uint64_t(rhs[i]) + borrow;
+        uint32_t current = lhs[i];
+
+        result[i] = static_cast<uint32_t>(current - subtrahend);
+        borrow = current < subtrahend;
+    }
+
+    return borrow;
+}
+
+int ScalarCompare(const uint32_t* lhs, const uint32_t* rhs, size_t size) {
+    for (size_t i = size; i-- > 0;) {
+        if (lhs[i] != rhs[i]) {
+            return lhs[i] < rhs[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+// Carries between lanes of a vector are resolved with one scalar addition.
+// For lane i let generate be set if lane i overflowed on its own and
+// propagate be set if it holds all ones, so that an incoming carry passes
+// through it. Adding the generated carries, shifted to the lanes that receive
+// them, to the propagate mask makes them ripple through propagating lanes the
+// same way carries ripple through bits. The bits that differ from the
+// propagate mask are the lanes that receive a carry.
+struct LaneCarries {
+    uint32_t incoming;
+    uint32_t out;
+};
+
+inline LaneCarries ResolveCarries(uint32_t generate, uint32_t propagate,
+                                  uint32_t carry, int lanes) {
+    uint32_t rippled = ((generate << 1) | carry) + propagate;
+    uint32_t mask = (1u << lanes) - 1;
+
+    return {
+        (rippled ^ propagate) & mask,
+        ((rippled >> lanes) | (generate >> (lanes - 1))) & 1,
+    };
+}
+
+#ifdef LIMB_KERNELS_X86
+
+// SSE2 and AVX2 only have signed comparisons, flipping the sign bit turns
+// them into unsigned ones.
+const uint32_t SIGN_BIT = 0x80000000u;
+
+__attribute__((target("sse2"))) uint32_t Sse2Add(const uint32_t* lhs,
+                                                 const uint32_t* rhs,
+                                                 uint32_t* result,
+                                                 size_t size) {
+    const __m128i sign = _mm_set1_epi32(SIGN_BIT);
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+
+    uint32_t carry = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= size; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+        __m128i sum = _mm_add_epi32(a, b);
+
+        __m128i overflow = _mm_cmpgt_epi32(_mm_xor_si128(a, sign),
+                                           _mm_xor_si128(sum, sign));
+        __m128i full = _mm_cmpeq_epi32(sum, ones);
+
+        LaneCarries carries =
+            ResolveCarries(_mm_movemask_ps(_mm_castsi128_ps(overflow)),
+                           _mm_movemask_ps(_mm_castsi128_ps(full)), carry, 4);
+
+        // Lanes receiving a carry get -1 in the mask, subtracting it adds one.
+        __m128i incoming = _mm_cmpeq_epi32(
+            _mm_and_si128(_mm_set1_epi32(carries.incoming), laneBits),
+            laneBits);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i),
+                         _mm_sub_epi32(sum, incoming));
+        carry = carries.out;
+    }
+
+    uint64_t tailCarry = carry;
+
+    for (; i < size; ++i) {
+        uint64_t sum = uint64_t(lhs[i]) + rhs[i] + tailCarry;
+        result[i] = static_cast<uint32_t>(sum);
+        tailCarry = sum >> 32;
+    }
+
+    return static_cast<uint32_t>(tailCarry);
+}
+
+__attribute__((target("sse2"))) uint32_t Sse2Subtract(const uint32_t* lhs,
+                                                      const uint32_t* rhs,
+                                                      uint32_t* result,
+                                                      size_t size) {
+    const __m128i sign = _mm_set1_epi32(SIGN_BIT);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+
+    uint32_t borrow = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= size; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+        __m128i difference = _mm_sub_epi32(a, b);
+
+        // A lane borrows on its own if a < b, and passes an incoming borrow
+        // on if its difference is zero.
+        __m128i underflow = _mm_cmpgt_epi32(_mm_xor_si128(b, sign),
+                                            _mm_xor_si128(a, sign));
+        __m128i empty = _mm_cmpeq_epi32(difference, zero);
+
+        LaneCarries borrows =
+            ResolveCarries(_mm_movemask_ps(_mm_castsi128_ps(underflow)),
+                           _mm_movemask_ps(_mm_castsi128_ps(empty)), borrow, 4);
+
+        __m128i incoming = _mm_cmpeq_epi32(
+            _mm_and_si128(_mm_set1_epi32(borrows.incoming), laneBits),
+            laneBits);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i),
+                         _mm_add_epi32(difference, incoming));
+        borrow = borrows.out;
+    }
+
+    for (; i < size; ++i) {
+        uint64_t subtrahend = uint64_t(rhs[i]) + borrow;
+        uint32_t current = lhs[i];
+
+        result[i] = static_cast<uint32_t>(current - subtrahend);
+        borrow = current < subtrahend;
+    }
+
+    return borrow;
+}
+
+__attribute__((target("sse2"))) int Sse2Compare(const uint32_t* lhs,
+                                                const uint32_t* rhs,
+                                                size_t size) {
+    size_t i = size;
+
+    for (; i >= 4; i -= 4) {
+        __m128i a =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i - 4));
+        __m128i b =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i - 4));
+        int equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+
+        if (equal != 0xF) {
+            // The highest lane that differs decides.
+            size_t lane = i - 4 + (31 - std::countl_zero(uint32_t(~equal & 0xF)));
+            return lhs[lane] < rhs[lane] ? -1 : 1;
+        }
+    }
+
+    return ScalarCompare(lhs, rhs, i);
+}
+
+__attribute__((target("avx2"))) uint32_t Avx2Add(const uint32_t* lhs,
+                                                 const uint32_t* rhs,
+                                                 uint32_t* result,
+                                                 size_t size) {
+    const __m256i sign = _mm256_set1_epi32(SIGN_BIT);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+    uint32_t carry = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+        __m256i sum = _mm256_add_epi32(a, b);
+
+        __m256i overflow = _mm256_cmpgt_epi32(_mm256_xor_si256(a, sign),
+                                              _mm256_xor_si256(sum, sign));
+        __m256i full = _mm256_cmpeq_epi32(sum, ones);
+
+        LaneCarries carries = ResolveCarries(
+            _mm256_movemask_ps(_mm256_castsi256_ps(overflow)),
+            _mm256_movemask_ps(_mm256_castsi256_ps(full)), carry, 8);
+
+        __m256i incoming = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(carries.incoming), laneBits),
+            laneBits);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i),
+                            _mm256_sub_epi32(sum, incoming));
+        carry = carries.out;
+    }
+
+    uint64_t tailCarry = carry;
+
+    for (; i < size; ++i) {
+        uint64_t sum = uint64_t(lhs[i]) + rhs[i] + tailCarry;
+        result[i] = static_cast<uint32_t>(sum);
+        tailCarry = sum >> 32;
+    }
+
+    return static_cast<uint32_t>(tailCarry);
+}
+
+__attribute__((target("avx2"))) uint32_t Avx2Subtract(const uint32_t* lhs,
+                                                      const uint32_t* rhs,
+                                                      uint32_t* result,
+                                                      size_t size) {
+    const __m256i sign = _mm256_set1_epi32(SIGN_BIT);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+    uint32_t borrow = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+        __m256i difference = _mm256_sub_epi32(a, b);
+
+        __m256i underflow = _mm256_cmpgt_epi32(_mm256_xor_si256(b, sign),
+                                               _mm256_xor_si256(a, sign));
+        __m256i empty = _mm256_cmpeq_epi32(difference, zero);
+
+        LaneCarries borrows = ResolveCarries(
+            _mm256_movemask_ps(_mm256_castsi256_ps(underflow)),
+            _mm256_movemask_ps(_mm256_castsi256_ps(empty)), borrow, 8);
+
+        __m256i incoming = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(borrows.incoming), laneBits),
+            laneBits);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i),
+                            _mm256_add_epi32(difference, incoming));
+        borrow = borrows.out;
+    }
+
+    for (; i < size; ++i) {
+        uint64_t subtrahend = uint64_t(rhs[i]) + borrow;
+        uint32_t current = lhs[i];
+
+        result[i] = static_cast<uint32_t>(current - subtrahend);
+        borrow = current < subtrahend;
+    }
+
+    return borrow;
+}
+
+__attribute__((target("avx2"))) int Avx2Compare(const uint32_t* lhs,
+                                                const uint32_t* rhs,
+                                                size_t size) {
+    size_t i = size;
+
+    for (; i >= 8; i -= 8) {
+        __m256i a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(lhs + i - 8));
+        __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(rhs + i - 8));
+        int equal = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)));
+
+        if (equal != 0xFF) {
+            size_t lane =
+                i - 8 + (31 - std::countl_zero(uint32_t(~equal & 0xFF)));
+            return lhs[lane] < rhs[lane] ? -1 : 1;
+        }
+    }
+
+    return ScalarCompare(lhs, rhs, i);
+}
+
+#endif
+
+const LimbKernels scalarKernels = {
+    "scalar", ScalarAdd, ScalarSubtract, ScalarCompare,
+};
+
+#ifdef LIMB_KERNELS_X86
+const LimbKernels sse2Kernels = {
+    "sse2", Sse2Add, Sse2Subtract, Sse2Compare,
+};
+
+const LimbKernels avx2Kernels = {
+    "avx2", Avx2Add, Avx2Subtract, Avx2Compare,
+};
+#endif
+
+const LimbKernels* activeKernels = nullptr;
+
+}  // namespace
+
+const std::vector<const LimbKernels*>& AvailableLimbKernels() {
+    static const std::vector<const LimbKernels*> available = [] {
+        std::vector<const LimbKernels*> result = { &scalarKernels };
+
+#ifdef LIMB_KERNELS_X86
+        // SSE2 is part of every x86-64 CPU but not of every 32-bit one.
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("sse2")) {
+            result.push_back(&sse2Kernels);
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            result.push_back(&avx2Kernels);
+        }
+#endif
+
+        return result;
+    }();
+
+    return available;
+}
+
+const LimbKernels& ActiveLimbKernels() {
+    if (activeKernels == nullptr) {
+        activeKernels = AvailableLimbKernels().back();
+    }
+
+    return *activeKernels;
+}
+
+void SetActiveLimbKernels(const LimbKernels& kernels) {
+    activeKernels = &kernels;
+}
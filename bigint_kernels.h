@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Inner loops of BigInteger arithmetic over equally long limb ranges. Every
+// implementation computes exactly the same results, they only differ in the
+// instruction set they use.
+struct LimbKernels {
+    const char* name;
+
+    // result = lhs + rhs, returns the carry out of the top limb. result may
+    // be the same range as lhs.
+    uint32_t (*add)(const uint32_t* lhs, const uint32_t* rhs, uint32_t* result,
+                    size_t size);
+
+    // result = lhs - rhs, returns the borrow out of the top limb. result may
+    // be the same range as either operand.
+    uint32_t (*subtract)(const uint32_t* lhs, const uint32_t* rhs,
+                         uint32_t* result, size_t size);
+
+    // Compares starting from the most significant limb, returns -1, 0 or 1.
+    int (*compare)(const uint32_t* lhs, const uint32_t* rhs, size_t size);
+};
+
+// All implementations the current CPU can run, scalar first.
+const std::vector<const LimbKernels*>& AvailableLimbKernels();
+
+// The kernels used by BigInteger. Defaults to the widest supported
+// implementation.
+const LimbKernels& ActiveLimbKernels();
+
+void SetActiveLimbKernels(const LimbKernels& kernels);
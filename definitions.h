@@ -38,5 +38,14 @@ extern std::map<std::string, int> tokenToYylVal;
 extern std::map<int, std::string> yylValToToken;
 extern std::vector<nodeType*> returnList;
 
+// Record types known to the compiler, and the type each variable of the
+// function being compiled was last declared with by record T v;. Field
+// accesses compile to the offset in that type when there is one.
+extern std::map<std::string, std::vector<std::string>> recordTypes;
+extern std::map<std::string, std::string> recordVariables;
+
+void DeclareRecord(const std::string& name,
+    const std::vector<std::string>& fields);
+
 extern std::string outputFile;
 extern std::ostream* outputPtr;
@@ -0,0 +1,305 @@
+#include "heap.h"
+
+#include <algorithm>
+
+#include "nodes.h"
+#include "vm_definitions.h"
+
+Heap::Heap(HeapOptions options)
+    : _options(options)
+    , _threshold(options.initialThreshold)
+    , _nurseryCapacity(
+          std::max<size_t>(1, options.nurseryBytes / sizeof(IntegerNode)))
+{
+    _nursery = static_cast<char*>(
+        Arena::AllocatePages(_nurseryCapacity * sizeof(IntegerNode)));
+    _survivors = static_cast<char*>(
+        Arena::AllocatePages(_nurseryCapacity * sizeof(IntegerNode)));
+}
+
+Heap::~Heap()
+{
+    for (size_t i = 0; i < _nurseryTop; ++i) {
+        NurserySlot(i)->~IntegerNode();
+    }
+
+    // The arena frees the memory of old nodes, and record layouts may be
+    // gone already, so only their destructors are run.
+    for (VmNode* node : _objects) {
+        Finalize(node);
+    }
+
+    Arena::FreePages(_nursery, _nurseryCapacity * sizeof(IntegerNode));
+    Arena::FreePages(_survivors, _nurseryCapacity * sizeof(IntegerNode));
+}
+
+RecordNode* Heap::AllocateRecord(const RecordLayout* layout)
+{
+    RecordNode* record = RecordNode::Create(
+        layout, _arena.Allocate(RecordNode::AllocationSize(layout)));
+    AddOld(record);
+
+    return record;
+}
+
+void Heap::Free(VmNode* node)
+{
+    if (node->IsYoung()) {
+        // Only the newest young node can be given back, the others are
+        // dropped by the next scavenge.
+        if (_nurseryTop > 0 && node == NurserySlot(_nurseryTop - 1)) {
+            _youngBytes -= std::min(_youngBytes, NodeBytes(node));
+            static_cast<IntegerNode*>(node)->~IntegerNode();
+            --_nurseryTop;
+        }
+
+        return;
+    }
+
+    // The node may have grown since it was counted, the next collection
+    // recounts everything anyway.
+    _bytes -= std::min(_bytes, NodeBytes(node));
+
+    VmNode* last = _objects.back();
+    last->SetHeapIndex(node->GetHeapIndex());
+    _objects[node->GetHeapIndex()] = last;
+    _objects.pop_back();
+
+    Destroy(node);
+}
+
+void Heap::RecordWrite(VmValue& cell)
+{
+    if (cell.GetType() == VALUE_TYPE_BIG_INTEGER && cell.Big()->IsYoung()) {
+        _remembered.push_back(&cell);
+    }
+}
+
+IntegerNode* Heap::NurserySlot(size_t index) const
+{
+    return reinterpret_cast<IntegerNode*>(
+        _nursery + index * sizeof(IntegerNode));
+}
+
+IntegerNode* Heap::SurvivorSlot(size_t index) const
+{
+    return reinterpret_cast<IntegerNode*>(
+        _survivors + index * sizeof(IntegerNode));
+}
+
+bool Heap::InNursery(const VmNode* node) const
+{
+    const char* address = reinterpret_cast<const char*>(node);
+
+    return address >= _nursery
+        && address < _nursery + _nurseryCapacity * sizeof(IntegerNode);
+}
+
+void* Heap::AllocateYoung()
+{
+    if (NurseryFull()) {
+        return nullptr;
+    }
+
+    return NurserySlot(_nurseryTop++);
+}
+
+void Heap::AddOld(VmNode* node)
+{
+    node->SetHeapIndex(_objects.size());
+    _objects.push_back(node);
+    _bytes += NodeBytes(node);
+}
+
+void Heap::Scavenge(VmValue& value)
+{
+    // A cell can be remembered twice, its node may already be a copy in the
+    // survivor space.
+    if (value.GetType() == VALUE_TYPE_BIG_INTEGER && InNursery(value.Big())) {
+        value = VmValue(Evacuate(value.Big()));
+    }
+}
+
+IntegerNode* Heap::Evacuate(IntegerNode* node)
+{
+    if (VmNode* forwarded = node->GetForwarded()) {
+        return static_cast<IntegerNode*>(forwarded);
+    }
+
+    IntegerNode* copy;
+    size_t age = node->GetAge() + 1;
+    size_t bytes = NodeBytes(node);
+
+    // Survivors must leave room in their semispace, or the next scavenge
+    // would be due right away.
+    if (!_promoteAll && age < _options.promotionAge
+        && _survivorTop < _nurseryCapacity
+        && _survivorBytes + bytes < _options.nurseryBytes) {
+        copy = new (SurvivorSlot(_survivorTop++))
+            IntegerNode(std::move(node->MutableValue()));
+        copy->SetYoung(true);
+        copy->SetAge(age);
+        _survivorBytes += bytes;
+    } else {
+        copy = new (_arena.Allocate(sizeof(IntegerNode)))
+            IntegerNode(std::move(node->MutableValue()));
+        AddOld(copy);
+    }
+
+    copy->SetTemporary(node->IsTemporary());
+    node->SetForwarded(copy);
+
+    return copy;
+}
+
+void Heap::FinishScavenge()
+{
+    size_t kept = 0;
+
+    // Cells whose node is still young after the copy have to be looked at
+    // by the next scavenge as well.
+    for (VmValue* cell : _remembered) {
+        Scavenge(*cell);
+
+        if (cell->GetType() == VALUE_TYPE_BIG_INTEGER
+            && cell->Big()->IsYoung()) {
+            _remembered[kept++] = cell;
+        }
+    }
+
+    _remembered.resize(kept);
+
+    // Survivors have been moved out, everything left is garbage.
+    for (size_t i = 0; i < _nurseryTop; ++i) {
+        NurserySlot(i)->~IntegerNode();
+    }
+
+    std::swap(_nursery, _survivors);
+    _nurseryTop = _survivorTop;
+    _survivorTop = 0;
+    _youngBytes = _survivorBytes;
+    _survivorBytes = 0;
+}
+
+void Heap::Mark(const VmValue& value)
+{
+    VmNode* node = value.Node();
+
+    if (node == nullptr || node->IsMarked()) {
+        return;
+    }
+
+    node->SetMarked(true);
+
+    if (value.IsArray() || value.IsRecord()) {
+        _grey.push_back(node);
+    }
+}
+
+void Heap::Sweep()
+{
+    // Contents are traced from an explicit stack, so deep structures do not
+    // recurse.
+    while (!_grey.empty()) {
+        VmNode* node = _grey.back();
+        _grey.pop_back();
+
+        if (node->GetNodeType() == NODE_TYPE_RECORD) {
+            RecordNode* record = static_cast<RecordNode*>(node);
+
+            for (size_t i = 0; i < record->Size(); ++i) {
+                Mark(record->Field(i));
+            }
+
+            continue;
+        }
+
+        ArrayNode* array = static_cast<ArrayNode*>(node);
+
+        // The elements of a slice are those of its base.
+        if (array->IsSlice()) {
+            Mark(VmValue(array->Base()));
+            continue;
+        }
+
+        if (array->IsDense()) {
+            continue;
+        }
+
+        // Chunks that were never written hold only zeros.
+        array->ForEachWritten([this](const VmValue& value) { Mark(value); });
+    }
+
+    size_t live = 0;
+    size_t kept = 0;
+
+    for (VmNode* node : _objects) {
+        if (!node->IsMarked()) {
+            Destroy(node);
+            continue;
+        }
+
+        node->SetMarked(false);
+        live += NodeBytes(node);
+        node->SetHeapIndex(kept);
+        _objects[kept++] = node;
+    }
+
+    _objects.resize(kept);
+    _bytes = live;
+    _threshold = std::max(_options.initialThreshold,
+        static_cast<size_t>(live * _options.growthFactor));
+}
+
+size_t Heap::NodeBytes(const VmNode* node)
+{
+    switch (node->GetNodeType()) {
+    case NODE_TYPE_INTEGER:
+        return sizeof(IntegerNode)
+            + static_cast<const IntegerNode*>(node)->RealValue().HeapBytes();
+    case NODE_TYPE_ARRAY: {
+        const ArrayNode* array = static_cast<const ArrayNode*>(node);
+
+        if (array->IsSlice()) {
+            return sizeof(ArrayNode);
+        }
+
+        return sizeof(ArrayNode) + array->BackedBytes();
+    }
+    case NODE_TYPE_RECORD:
+        return sizeof(RecordNode)
+            + static_cast<const RecordNode*>(node)->Size() * sizeof(VmValue);
+    }
+
+    return 0;
+}
+
+void Heap::Destroy(VmNode* node)
+{
+    size_t size = sizeof(IntegerNode);
+
+    if (node->GetNodeType() == NODE_TYPE_ARRAY) {
+        size = sizeof(ArrayNode);
+    } else if (node->GetNodeType() == NODE_TYPE_RECORD) {
+        size = RecordNode::AllocationSize(
+            static_cast<RecordNode*>(node)->Layout());
+    }
+
+    Finalize(node);
+    _arena.Deallocate(node, size);
+}
+
+void Heap::Finalize(VmNode* node)
+{
+    switch (node->GetNodeType()) {
+    case NODE_TYPE_INTEGER:
+        static_cast<IntegerNode*>(node)->~IntegerNode();
+        break;
+    case NODE_TYPE_ARRAY:
+        static_cast<ArrayNode*>(node)->~ArrayNode();
+        break;
+    case NODE_TYPE_RECORD:
+        static_cast<RecordNode*>(node)->~RecordNode();
+        break;
+    }
+}
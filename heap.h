@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+
+class VmNode;
+class VmValue;
+class IntegerNode;
+class ArrayNode;
+class RecordNode;
+struct RecordLayout;
+
+struct HeapOptions {
+    // Bytes of old nodes allocated before the first full collection.
+    size_t initialThreshold = 8 * 1024 * 1024;
+
+    // After a full collection the next one is due once the old space has
+    // grown to this many times the bytes that survived it.
+    double growthFactor = 2.0;
+
+    // Bytes of young nodes, with the limbs they own, that each of the two
+    // nursery semispaces holds before a scavenge is due.
+    size_t nurseryBytes = 1024 * 1024;
+
+    // Scavenges a young node survives before it is moved to the old space.
+    size_t promotionAge = 2;
+};
+
+// Owner of all VM nodes, split into two generations.
+//
+// Big integers are born in the nursery, a pair of semispaces that is
+// allocated from by bumping an index. Both come from Arena::AllocatePages(),
+// so large nurseries are backed by huge pages. Most of them are dead within a few
+// instructions, so a scavenge copies the few survivors to the other
+// semispace and drops the rest at once. A semispace is full when its slots
+// run out or when its nodes and their limbs take nurseryBytes. Nodes that
+// survive promotionAge scavenges, or that do not fit into the other
+// semispace, are promoted to the old space. Arrays, their slices and records are created in the old space
+// directly.
+//
+// The old space is collected by a precise mark-sweep when it outgrows its
+// threshold, after a scavenge that promotes every young survivor. Large
+// arrays count only the chunks of their storage that have been written, the
+// VM adds the others with AddBytes() as stores reach them.
+//
+// Allocation never collects by itself: the operands of the instruction being
+// executed are already popped and would not be found from the roots. It only
+// makes ShouldCollect() true, and the VM calls Collect() between
+// instructions with every value on the operand stack and in frame variables.
+// Variables are scanned on every scavenge, so only stores into array cells
+// and record fields, which are old, have to go through RecordWrite().
+class Heap {
+public:
+    explicit Heap(HeapOptions options = {});
+
+    Heap(const Heap&) = delete;
+
+    ~Heap();
+
+public:
+    Heap& operator=(const Heap&) = delete;
+
+public:
+    template <typename T, typename... Args>
+    T* Allocate(Args&&... args)
+    {
+        if constexpr (std::is_same_v<T, IntegerNode>) {
+            if (void* memory = AllocateYoung()) {
+                T* node = new (memory) T(std::forward<Args>(args)...);
+                node->SetYoung(true);
+                _youngBytes += NodeBytes(node);
+
+                return node;
+            }
+        }
+
+        T* node = new (_arena.Allocate(sizeof(T))) T(std::forward<Args>(args)...);
+        AddOld(node);
+
+        return node;
+    }
+
+    RecordNode* AllocateRecord(const RecordLayout* layout);
+
+    // Frees a node right away. Only for nodes that nothing refers to.
+    void Free(VmNode* node);
+
+    // Write barrier, to be called after a value is stored into an array
+    // cell or a record field.
+    void RecordWrite(VmValue& cell);
+
+    // Counts memory that an old node has taken since it was allocated, such
+    // as array storage that a store backed for the first time.
+    void AddBytes(size_t bytes) { _bytes += bytes; }
+
+    bool ShouldCollect() const
+    {
+        return NurseryFull() || _bytes >= _threshold;
+    }
+
+    // Takes a function that calls its argument with a VmValue& for every
+    // root. Young nodes move, so the roots are updated in place.
+    template <typename ForEachRoot>
+    void Collect(ForEachRoot forEachRoot)
+    {
+        bool full = _bytes >= _threshold;
+
+        _promoteAll = full;
+        forEachRoot([this](VmValue& value) { Scavenge(value); });
+        FinishScavenge();
+
+        if (full) {
+            forEachRoot([this](const VmValue& value) { Mark(value); });
+            Sweep();
+        }
+    }
+
+    // Bytes of old nodes, including garbage not yet collected.
+    size_t Bytes() const { return _bytes; }
+
+private:
+    // Size of the node with the memory it owns, as counted against the
+    // thresholds.
+    static size_t NodeBytes(const VmNode* node);
+
+    // Destroys an old node as the type it was created with and gives its
+    // memory back to the arena.
+    void Destroy(VmNode* node);
+
+    // Only runs the destructor of the node's type.
+    static void Finalize(VmNode* node);
+
+    IntegerNode* NurserySlot(size_t index) const;
+    IntegerNode* SurvivorSlot(size_t index) const;
+
+    bool InNursery(const VmNode* node) const;
+
+    bool NurseryFull() const
+    {
+        return _nurseryTop == _nurseryCapacity
+            || _youngBytes >= _options.nurseryBytes;
+    }
+
+    // Next nursery slot, nullptr when the nursery is full.
+    void* AllocateYoung();
+
+    void AddOld(VmNode* node);
+
+    void Scavenge(VmValue& value);
+    IntegerNode* Evacuate(IntegerNode* node);
+    void FinishScavenge();
+
+    void Mark(const VmValue& value);
+    void Sweep();
+
+private:
+    HeapOptions _options;
+
+    // Old space. The nodes are allocated from the arena.
+    Arena _arena;
+    std::vector<VmNode*> _objects;
+    size_t _bytes = 0;
+    size_t _threshold;
+
+    // Marked arrays and records whose contents are not traced yet.
+    std::vector<VmNode*> _grey;
+
+    // Nursery: slots [0, _nurseryTop) of _nursery are in use, _survivors is
+    // the other semispace that a scavenge copies into. The byte counts
+    // include limbs as of allocation or copy, values grown in place since
+    // are recounted by the next scavenge.
+    char* _nursery;
+    char* _survivors;
+    size_t _nurseryCapacity;
+    size_t _nurseryTop = 0;
+    size_t _survivorTop = 0;
+    size_t _youngBytes = 0;
+    size_t _survivorBytes = 0;
+    bool _promoteAll = false;
+
+    // Array cells and record fields that may point into the nursery.
+    std::vector<VmValue*> _remembered;
+};
@@ -0,0 +1,255 @@
+#include "integer.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+Integer::Integer() : _small(0) {}
+
+Integer::Integer(int64_t value) : _small(value) {}
+
+Integer::Integer(const std::string& value) : _small(0) {
+    const char* begin = value.data();
+    const char* end = value.data() + value.size();
+
+    // Literals that are too long for int64_t fail with result_out_of_range and
+    // take the BigInteger path.
+    auto [ptr, error] = std::from_chars(begin, end, _small);
+
+    if (error == std::errc() && ptr == end) {
+        return;
+    }
+
+    _big = std::make_unique<BigInteger>(value, !value.empty() && value[0] == '-');
+    Demote();
+}
+
+Integer::Integer(BigInteger value)
+    : _small(0), _big(std::make_unique<BigInteger>(std::move(value))) {
+    Demote();
+}
+
+Integer::Integer(const Integer& other) : _small(other._small) {
+    if (other._big) {
+        _big = std::make_unique<BigInteger>(*other._big);
+    }
+}
+
+Integer& Integer::operator=(const Integer& other) {
+    if (this != &other) {
+        _small = other._small;
+        _big = other._big ? std::make_unique<BigInteger>(*other._big) : nullptr;
+    }
+
+    return *this;
+}
+
+void Integer::Demote() {
+    if (_big && _big->FitsInt64()) {
+        _small = _big->ToInt64();
+        _big.reset();
+    }
+}
+
+void Integer::Promote() {
+    if (!_big) {
+        _big = std::make_unique<BigInteger>(_small);
+    }
+}
+
+bool Integer::IsSmall() const { return !_big; }
+
+int64_t Integer::Small() const { return _small; }
+
+bool Integer::IsZero() const { return !_big && _small == 0; }
+
+BigInteger Integer::ToBigInteger() const {
+    return _big ? *_big : BigInteger(_small);
+}
+
+Integer Integer::operator+(const Integer& other) const {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_add_overflow(_small, other._small, &result)) {
+        return Integer(result);
+    }
+
+    return Integer(ToBigInteger() + other.ToBigInteger());
+}
+
+Integer Integer::operator-(const Integer& other) const {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_sub_overflow(_small, other._small, &result)) {
+        return Integer(result);
+    }
+
+    return Integer(ToBigInteger() - other.ToBigInteger());
+}
+
+Integer Integer::operator*(const Integer& other) const {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_mul_overflow(_small, other._small, &result)) {
+        return Integer(result);
+    }
+
+    return Integer(ToBigInteger() * other.ToBigInteger());
+}
+
+Integer Integer::operator/(const Integer& other) const {
+    return DivMod(other).first;
+}
+
+Integer Integer::operator%(const Integer& other) const {
+    return DivMod(other).second;
+}
+
+std::pair<Integer, Integer> Integer::DivMod(const Integer& other) const {
+    if (other.IsZero()) {
+        throw std::runtime_error("division by zero");
+    }
+
+    // INT64_MIN / -1 is the only quotient of two int64_t that overflows.
+    if (IsSmall() && other.IsSmall() &&
+        !(_small == INT64_MIN && other._small == -1)) {
+        int64_t quotient = _small / other._small;
+        int64_t remainder = _small % other._small;
+
+        // Round towards negative infinity, same as BigInteger does. The
+        // remainder then takes the sign of the divisor.
+        if (remainder != 0 && ((remainder < 0) != (other._small < 0))) {
+            --quotient;
+            remainder += other._small;
+        }
+
+        return { Integer(quotient), Integer(remainder) };
+    }
+
+    auto [quotient, remainder] = ToBigInteger().DivMod(other.ToBigInteger());
+
+    return { Integer(std::move(quotient)), Integer(std::move(remainder)) };
+}
+
+Integer& Integer::operator+=(const Integer& other) {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_add_overflow(_small, other._small, &result)) {
+        _small = result;
+        return *this;
+    }
+
+    Promote();
+    *_big += other.IsSmall() ? BigInteger(other._small) : *other._big;
+    Demote();
+
+    return *this;
+}
+
+Integer& Integer::operator-=(const Integer& other) {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_sub_overflow(_small, other._small, &result)) {
+        _small = result;
+        return *this;
+    }
+
+    Promote();
+    *_big -= other.IsSmall() ? BigInteger(other._small) : *other._big;
+    Demote();
+
+    return *this;
+}
+
+Integer& Integer::operator*=(const Integer& other) {
+    int64_t result;
+
+    if (IsSmall() && other.IsSmall() &&
+        !__builtin_mul_overflow(_small, other._small, &result)) {
+        _small = result;
+        return *this;
+    }
+
+    Promote();
+
+    // Factorial-like loops multiply a big accumulator by a small counter,
+    // which needs no temporary at all.
+    if (other.IsSmall() && other._small >= -int64_t(UINT32_MAX) &&
+        other._small <= int64_t(UINT32_MAX)) {
+        _big->MultiplyByWord(static_cast<uint32_t>(std::abs(other._small)));
+
+        if (other._small < 0) {
+            _big->Negate();
+        }
+    } else {
+        *_big *= other.IsSmall() ? BigInteger(other._small) : *other._big;
+    }
+
+    Demote();
+
+    return *this;
+}
+
+int Integer::Compare(const Integer& other) const {
+    if (IsSmall() && other.IsSmall()) {
+        return (_small > other._small) - (_small < other._small);
+    }
+
+    // Big values never fit into int64_t, so against a small one only their
+    // sign matters.
+    if (IsSmall()) {
+        return other._big->IsNegative() ? 1 : -1;
+    }
+
+    if (other.IsSmall()) {
+        return _big->IsNegative() ? -1 : 1;
+    }
+
+    return _big->Compare(*other._big);
+}
+
+bool Integer::operator<(const Integer& other) const {
+    return Compare(other) < 0;
+}
+
+bool Integer::operator>(const Integer& other) const {
+    return Compare(other) > 0;
+}
+
+bool Integer::operator<=(const Integer& other) const {
+    return Compare(other) <= 0;
+}
+
+bool Integer::operator>=(const Integer& other) const {
+    return Compare(other) >= 0;
+}
+
+bool Integer::operator!=(const Integer& other) const {
+    return Compare(other) != 0;
+}
+
+bool Integer::operator==(const Integer& other) const {
+    return Compare(other) == 0;
+}
+
+std::string Integer::Value() const {
+    return _big ? _big->Value() : std::to_string(_small);
+}
+
+void Integer::Negate() {
+    if (_big) {
+        _big->Negate();
+        Demote();
+    } else if (_small == INT64_MIN) {
+        _big = std::make_unique<BigInteger>(_small);
+        _big->Negate();
+    } else {
+        _small = -_small;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "bigint.h"
+
+// Integer that keeps values fitting into int64_t inline and only falls back to
+// BigInteger when an operation overflows. Results that fit into int64_t again
+// are demoted back, so the slow path is taken only while the value is big.
+class Integer {
+public:
+    Integer();
+
+    Integer(int64_t value);
+
+    Integer(const std::string& value);
+
+    Integer(BigInteger value);
+
+    Integer(const Integer& other);
+
+    Integer(Integer&& other) = default;
+
+public:
+    Integer& operator=(const Integer& other);
+
+    Integer& operator=(Integer&& other) = default;
+
+public:
+    Integer operator+(const Integer& other) const;
+
+    Integer operator-(const Integer& other) const;
+
+    Integer operator*(const Integer& other) const;
+
+    Integer operator/(const Integer& other) const;
+
+    Integer operator%(const Integer& other) const;
+
+    // Floored quotient and remainder computed in one division.
+    std::pair<Integer, Integer> DivMod(const Integer& other) const;
+
+public:
+    // In-place versions that keep the BigInteger buffer of a big value.
+    Integer& operator+=(const Integer& other);
+
+    Integer& operator-=(const Integer& other);
+
+    Integer& operator*=(const Integer& other);
+
+public:
+    // Returns -1, 0 or 1 without promoting small values to BigInteger.
+    int Compare(const Integer& other) const;
+
+    bool operator<(const Integer& other) const;
+
+    bool operator>(const Integer& other) const;
+
+    bool operator<=(const Integer& other) const;
+
+    bool operator>=(const Integer& other) const;
+
+    bool operator!=(const Integer& other) const;
+
+    bool operator==(const Integer& other) const;
+
+public:
+    std::string Value() const;
+
+    void Negate();
+
+    bool IsZero() const;
+
+    bool IsSmall() const;
+
+    // Only valid when IsSmall() holds.
+    int64_t Small() const;
+
+    BigInteger ToBigInteger() const;
+
+private:
+    // Moves a big value back to the inline representation if it fits.
+    void Demote();
+
+    // Moves a small value to the BigInteger representation.
+    void Promote();
+
+private:
+    int64_t _small;
+
+    // Set only for values outside of the int64_t range.
+    std::unique_ptr<BigInteger> _big;
+};
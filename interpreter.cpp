@@ -1,10 +1,66 @@
+#include <algorithm>
 #include <cstdio>
+#include <stdexcept>
 
 #include "definitions.h"
 #include "y.tab.h"
 
 static int lbl;
 
+std::map<std::string, std::vector<std::string>> recordTypes;
+std::map<std::string, std::string> recordVariables;
+
+void DeclareRecord(const std::string& name,
+    const std::vector<std::string>& fields)
+{
+    if (recordTypes.contains(name)) {
+        throw std::runtime_error("record " + name + " is already declared");
+    }
+
+    for (auto field = fields.begin(); field != fields.end(); ++field) {
+        if (std::find(fields.begin(), field, *field) != field) {
+            throw std::runtime_error("field " + *field + " of record " + name
+                + " is declared twice");
+        }
+    }
+
+    recordTypes[name] = fields;
+}
+
+static const std::string& name(nodeType* p)
+{
+    return yylValToToken[std::get<idNodeType*>(p->value)->i];
+}
+
+// Offset compiled into getField and setField: the one the field has in the
+// type the variable was last declared with, -1 if that is not known. The VM
+// checks it against the layout of the record it finds and looks the field up
+// there when it does not match.
+static int fieldOffset(const std::string& variable, const std::string& field)
+{
+    bool declared = std::any_of(recordTypes.begin(), recordTypes.end(),
+        [&field](const auto& type) {
+            return std::find(type.second.begin(), type.second.end(), field)
+                != type.second.end();
+        });
+
+    if (!declared) {
+        throw std::runtime_error("no record has field " + field);
+    }
+
+    auto type = recordVariables.find(variable);
+
+    if (type == recordVariables.end()) {
+        return -1;
+    }
+
+    const std::vector<std::string>& fields = recordTypes[type->second];
+    auto offset = std::find(fields.begin(), fields.end(), field);
+
+    return offset != fields.end() ? static_cast<int>(offset - fields.begin())
+                                  : -1;
+}
+
 // If push is true, then in case of typeId it will push.
 // Otherwise it will pop.
 int ex(nodeType* p, bool push = true)
@@ -77,6 +133,25 @@ int ex(nodeType* p, bool push = true)
             ex(node->op[0]);
             output << "\tprint\n";
             break;
+        case DISCARD: {
+            // The values of an expression statement are dropped: one for
+            // most expressions, and all the results of a call, which is
+            // named so that the VM counts them from the callee's returns.
+            nodeType* expression = node->op[0];
+            ex(expression);
+
+            output << "\tdiscard\t";
+
+            if (expression->type == typeOpr
+                && std::get<oprNodeType*>(expression->value)->oper == CALL) {
+                output << name(std::get<oprNodeType*>(expression->value)->op[0]);
+            } else {
+                output << 1;
+            }
+
+            output << "\n";
+            break;
+        }
         case '=':
             for (int i = node->nops - 1; i >= 1; --i) {
                 ex(node->op[i]);
@@ -153,6 +228,48 @@ int ex(nodeType* p, bool push = true)
             output << "\tarray\t" << yylValToToken[id->i] << "\n";
             break;
         }
+        case RECORD: {
+            const std::string& type = name(node->op[0]);
+            auto fields = recordTypes.find(type);
+
+            if (fields == recordTypes.end()) {
+                throw std::runtime_error("unknown record " + type);
+            }
+
+            recordVariables[name(node->op[1])] = type;
+
+            output << "\trecord\t" << name(node->op[1]) << "\t" << type;
+
+            for (const auto& field : fields->second) {
+                output << "\t" << field;
+            }
+
+            output << "\n";
+            break;
+        }
+        case GET_FIELD: {
+            const std::string& field = name(node->op[1]);
+
+            output << "\tgetField\t" << name(node->op[0]) << "\t" << field
+                   << "\t" << fieldOffset(name(node->op[0]), field) << "\n";
+            break;
+        }
+        case '.': {
+            ex(node->op[2]);
+
+            const std::string& field = name(node->op[1]);
+
+            output << "\tsetField\t" << name(node->op[0]) << "\t" << field
+                   << "\t" << fieldOffset(name(node->op[0]), field) << "\n";
+            break;
+        }
+        case SLICE: {
+            ex(node->op[1]);
+            ex(node->op[2]);
+
+            output << "\tslice\t" << name(node->op[0]) << "\n";
+            break;
+        }
         case ACCESS: {
             ex(node->op.back());
 
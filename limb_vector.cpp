@@ -0,0 +1,120 @@
+#include "limb_vector.h"
+
+#include <algorithm>
+#include <cstring>
+
+LimbVector::LimbVector()
+    : _data(_inline), _size(0), _capacity(INLINE_CAPACITY) {}
+
+LimbVector::LimbVector(size_t size) : LimbVector() {
+    resize(size);
+}
+
+LimbVector::LimbVector(std::initializer_list<uint32_t> values)
+    : LimbVector(values.begin(), values.end()) {}
+
+LimbVector::LimbVector(const uint32_t* begin, const uint32_t* end)
+    : LimbVector() {
+    reserve(end - begin);
+    std::copy(begin, end, _data);
+    _size = end - begin;
+}
+
+LimbVector::LimbVector(const LimbVector& other)
+    : LimbVector(other.begin(), other.end()) {}
+
+LimbVector::LimbVector(LimbVector&& other) noexcept
+    : _data(_inline), _size(other._size), _capacity(INLINE_CAPACITY) {
+    if (other.IsInline()) {
+        std::memcpy(_inline, other._inline, sizeof(_inline));
+        return;
+    }
+
+    // Take over the heap buffer and leave other empty and inline.
+    _data = other._data;
+    _capacity = other._capacity;
+
+    other._data = other._inline;
+    other._size = 0;
+    other._capacity = INLINE_CAPACITY;
+}
+
+LimbVector::~LimbVector() {
+    if (!IsInline()) {
+        delete[] _data;
+    }
+}
+
+LimbVector& LimbVector::operator=(const LimbVector& other) {
+    if (this != &other) {
+        reserve(other._size);
+        std::copy(other.begin(), other.end(), _data);
+        _size = other._size;
+    }
+
+    return *this;
+}
+
+LimbVector& LimbVector::operator=(LimbVector&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+
+    if (other.IsInline()) {
+        std::memcpy(_data, other._inline, sizeof(_inline));
+        _size = other._size;
+        return *this;
+    }
+
+    if (!IsInline()) {
+        delete[] _data;
+    }
+
+    _data = other._data;
+    _size = other._size;
+    _capacity = other._capacity;
+
+    other._data = other._inline;
+    other._size = 0;
+    other._capacity = INLINE_CAPACITY;
+
+    return *this;
+}
+
+bool LimbVector::operator==(const LimbVector& other) const {
+    return std::equal(begin(), end(), other.begin(), other.end());
+}
+
+void LimbVector::resize(size_t size) {
+    reserve(size);
+
+    if (size > _size) {
+        std::fill(_data + _size, _data + size, 0);
+    }
+
+    _size = size;
+}
+
+void LimbVector::assign(size_t size, uint32_t value) {
+    reserve(size);
+    std::fill(_data, _data + size, value);
+    _size = size;
+}
+
+void LimbVector::reserve(size_t capacity) {
+    if (capacity > _capacity) {
+        Reallocate(std::max(capacity, _capacity * 2));
+    }
+}
+
+void LimbVector::Reallocate(size_t capacity) {
+    uint32_t* data = new uint32_t[capacity];
+    std::copy(begin(), end(), data);
+
+    if (!IsInline()) {
+        delete[] _data;
+    }
+
+    _data = data;
+    _capacity = capacity;
+}
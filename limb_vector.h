@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+// Limb storage of BigInteger. Up to INLINE_CAPACITY limbs (128 bits) are kept
+// inside the object itself, longer values move to the heap. The interface is
+// the subset of std::vector the arithmetic needs, so the algorithms do not
+// care which storage is in use.
+class LimbVector {
+public:
+    static constexpr size_t INLINE_CAPACITY = 4;
+
+public:
+    LimbVector();
+
+    // Zero-filled.
+    explicit LimbVector(size_t size);
+
+    LimbVector(std::initializer_list<uint32_t> values);
+
+    LimbVector(const uint32_t* begin, const uint32_t* end);
+
+    LimbVector(const LimbVector& other);
+
+    LimbVector(LimbVector&& other) noexcept;
+
+    ~LimbVector();
+
+public:
+    // Copying keeps the current buffer if it is big enough.
+    LimbVector& operator=(const LimbVector& other);
+
+    LimbVector& operator=(LimbVector&& other) noexcept;
+
+    bool operator==(const LimbVector& other) const;
+
+public:
+    size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    size_t capacity() const { return _capacity; }
+
+    uint32_t* data() { return _data; }
+
+    const uint32_t* data() const { return _data; }
+
+    uint32_t& operator[](size_t index) { return _data[index]; }
+
+    const uint32_t& operator[](size_t index) const { return _data[index]; }
+
+    uint32_t& back() { return _data[_size - 1]; }
+
+    const uint32_t& back() const { return _data[_size - 1]; }
+
+    uint32_t* begin() { return _data; }
+
+    const uint32_t* begin() const { return _data; }
+
+    uint32_t* end() { return _data + _size; }
+
+    const uint32_t* end() const { return _data + _size; }
+
+public:
+    void push_back(uint32_t value) {
+        if (_size == _capacity) {
+            Reallocate(_capacity * 2);
+        }
+
+        _data[_size++] = value;
+    }
+
+    void pop_back() { --_size; }
+
+    void clear() { _size = 0; }
+
+    // Limbs added at the end are zero.
+    void resize(size_t size);
+
+    void assign(size_t size, uint32_t value);
+
+    void reserve(size_t capacity);
+
+private:
+    bool IsInline() const { return _data == _inline; }
+
+    // Moves the limbs into a heap buffer of the given capacity.
+    void Reallocate(size_t capacity);
+
+private:
+    uint32_t* _data;
+    size_t _size;
+    size_t _capacity;
+    uint32_t _inline[INLINE_CAPACITY];
+};
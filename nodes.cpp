@@ -1,231 +1,181 @@
 #include "nodes.h"
 
+#include <algorithm>
 #include <memory>
+#include <ostream>
 #include <stdexcept>
 
 #include "bigint.h"
 #include "vm_definitions.h"
 
-IntegerNode::IntegerNode(int value)
-    : _value(BigInteger(value))
-{
-}
-
-IntegerNode::IntegerNode(const std::string& value)
-    : _value(BigInteger(value, value[0] == '-'))
-{
-}
-
 IntegerNode::IntegerNode(BigInteger value)
-    : _value(std::move(value))
+    : VmNode(NODE_TYPE_INTEGER)
+    , _value(std::move(value))
 {
 }
 
-VmNodeType IntegerNode::GetNodeType() const { return NODE_TYPE_INTEGER; }
+void IntegerNode::Print(std::ostream& stream) const { _value.Print(stream); }
 
-std::string IntegerNode::Value() const { return _value.Value(); }
+const BigInteger& IntegerNode::RealValue() const { return _value; }
 
-std::shared_ptr<VmNode> IntegerNode::Negate()
-{
-    BigInteger copy = _value;
-    copy.Negate();
+BigInteger& IntegerNode::MutableValue() { return _value; }
 
-    return std::make_shared<IntegerNode>(copy);
-}
-
-BigInteger IntegerNode::RealValue() const { return _value; }
-
-std::shared_ptr<VmNode> IntegerNode::operator+(const VmNode& other) const
+ArrayNode::ArrayNode(size_t size)
+    : VmNode(NODE_TYPE_ARRAY)
+    , _size(size)
+    , _integers(size)
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("summing integer and non-integer");
-    }
-
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return std::make_shared<IntegerNode>(this->RealValue() + casted.RealValue());
 }
 
-std::shared_ptr<VmNode> IntegerNode::operator-(const VmNode& other) const
+ArrayNode::ArrayNode(ArrayNode* array, size_t offset, size_t size)
+    : VmNode(NODE_TYPE_ARRAY)
+    , _size(size)
+    , _base(array->IsSlice() ? array->Base() : array)
+    , _offset(array->_offset + offset)
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("substracting integer and non-integer");
-    }
-
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return std::make_shared<IntegerNode>(this->RealValue() - casted.RealValue());
 }
 
-std::shared_ptr<VmNode> IntegerNode::operator*(const VmNode& other) const
+void ArrayNode::Print(std::ostream& stream) const
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("multiplying integer and non-integer");
-    }
+    stream << "[ ";
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return std::make_shared<IntegerNode>(this->RealValue() * casted.RealValue());
-}
+    for (size_t i = 0; i < Size(); ++i) {
+        if (i != 0) {
+            stream << ", ";
+        }
 
-std::shared_ptr<VmNode> IntegerNode::operator/(const VmNode& other) const
-{
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("dividing integer and non-integer");
+        Get(i).Print(stream);
     }
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return std::make_shared<IntegerNode>(this->RealValue() / casted.RealValue());
+    stream << " ]";
 }
 
-std::shared_ptr<VmNode> IntegerNode::operator%(const VmNode& other) const
+VmValue ArrayNode::Get(const VmValue& index) const
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("taking remainder of integer and non-integer");
-    }
-
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return std::make_shared<IntegerNode>(this->RealValue() % casted.RealValue());
+    return Get(ConvertIndexToSizeT(index));
 }
 
-bool IntegerNode::operator<(const VmNode& other) const
+size_t ArrayNode::Set(const VmValue& index, const VmValue& value)
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("< integer and non-integer");
-    }
-
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return this->RealValue() < casted.RealValue();
+    return Set(ConvertIndexToSizeT(index), value);
 }
 
-bool IntegerNode::operator>(const VmNode& other) const
+size_t ArrayNode::ConvertIndexToSizeT(const VmValue& value) const
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("> integer and non-integer");
+    if (!value.IsInteger()) {
+        throw std::runtime_error("provided array index is not integer");
     }
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return this->RealValue() > casted.RealValue();
-}
-
-bool IntegerNode::operator<=(const VmNode& other) const
-{
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("<= integer and non-integer");
+    // Array sizes are bounded, so any valid index is a small integer.
+    if (!value.IsSmall() || value.Small() < 0
+        || static_cast<uint64_t>(value.Small()) >= Size()) {
+        throw std::runtime_error("index out of range while accessing array");
     }
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return this->RealValue() <= casted.RealValue();
+    return static_cast<size_t>(value.Small());
 }
 
-bool IntegerNode::operator>=(const VmNode& other) const
+size_t ArrayNode::ConvertBoundToSizeT(const VmValue& value) const
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error(">= integer and non-integer");
+    if (!value.IsInteger()) {
+        throw std::runtime_error("provided slice bound is not integer");
     }
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return this->RealValue() >= casted.RealValue();
-}
-
-bool IntegerNode::operator!=(const VmNode& other) const
-{
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("!= integer and non-integer");
+    if (!value.IsSmall() || value.Small() < 0
+        || static_cast<uint64_t>(value.Small()) > Size()) {
+        throw std::runtime_error("slice bound out of range");
     }
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
-
-    return this->RealValue() != casted.RealValue();
+    return static_cast<size_t>(value.Small());
 }
 
-bool IntegerNode::operator==(const VmNode& other) const
+size_t ArrayNode::MakeGeneral()
 {
-    if (this->GetNodeType() != other.GetNodeType()) {
-        throw std::runtime_error("== integer and non-integer");
-    }
+    _values = ZeroFilledArray<VmValue>(_size);
 
-    const IntegerNode& casted = static_cast<const IntegerNode&>(other);
+    // Zeros are already there, skipping them leaves untouched pages alone.
+    _integers.ForEachWritten([this](size_t i, int64_t integer) {
+        if (integer != 0) {
+            _values.Store(i, VmValue(integer));
+        }
+    });
 
-    return this->RealValue() == casted.RealValue();
-}
+    _integers = ZeroFilledArray<int64_t>();
+    _dense = false;
 
-ArrayNode::ArrayNode(size_t size, Frame& frame)
-    : _value(std::vector<std::weak_ptr<VmNode>>(size))
-{
-    for (size_t i = 0; i < size; ++i) {
-        frame.objects.push_back(std::make_shared<IntegerNode>(0));
-        _value[i] = frame.objects.back();
-    }
+    return _values.BackedBytes();
 }
 
-bool ArrayNode::operator!=(const VmNode& other) const
+RecordNode::RecordNode(const RecordLayout* layout)
+    : VmNode(NODE_TYPE_RECORD)
+    , _layout(layout)
 {
-    return !(*this == other);
 }
 
-bool ArrayNode::operator==(const VmNode& other) const
+size_t RecordNode::AllocationSize(const RecordLayout* layout)
 {
-    // Works only with 0. That is an equivalent of checking for nulls.
-    if (other.GetNodeType() != NODE_TYPE_INTEGER || other.Value() != "0") {
-        throw new std::runtime_error("cannot compare arrays with value other than 0 (null)");
-    }
+    static_assert(sizeof(RecordNode) % alignof(VmValue) == 0);
 
-    // Always return false since the array node surely exists due to the fact
-    // that we somehow got to this piece of code.
-    return false;
+    return sizeof(RecordNode) + layout->fields.size() * sizeof(VmValue);
 }
 
-VmNodeType ArrayNode::GetNodeType() const { return NODE_TYPE_ARRAY; };
-
-std::string ArrayNode::Value() const
+RecordNode* RecordNode::Create(const RecordLayout* layout, void* memory)
 {
-    std::string result;
+    RecordNode* record = new (memory) RecordNode(layout);
 
-    for (size_t i = 0; i < _value.size(); ++i) {
-        if (i == _value.size() - 1) {
-            result += _value[i].lock()->Value();
-        } else {
-            result += _value[i].lock()->Value() + ", ";
-        }
-    }
+    std::uninitialized_default_construct_n(record->Fields(), layout->fields.size());
 
-    return "[ " + result + " ]";
+    return record;
 }
 
-size_t ArrayNode::Size() const { return _value.size(); }
-
-const std::weak_ptr<VmNode>& ArrayNode::Get(size_t index) const
+int RecordNode::FindField(int fieldName) const
 {
-    return _value[index];
-}
+    const std::vector<int>& names = _layout->fieldNames;
+    auto field = std::find(names.begin(), names.end(), fieldName);
 
-void ArrayNode::Set(size_t index, std::weak_ptr<VmNode> value)
-{
-    _value[index] = value;
+    return field != names.end() ? static_cast<int>(field - names.begin()) : -1;
 }
 
-const std::weak_ptr<VmNode>& ArrayNode::Get(const BigInteger& index) const
+void RecordNode::Print(std::ostream& stream) const
 {
-    return Get(ConvertBigIntegerToSizeT(index));
-}
+    stream << _layout->name << " {";
 
-void ArrayNode::Set(const BigInteger& index, std::weak_ptr<VmNode> value)
-{
-    Set(ConvertBigIntegerToSizeT(index), value);
+    for (size_t i = 0; i < Size(); ++i) {
+        stream << (i == 0 ? " " : ", ") << _layout->fields[i] << ": ";
+        Fields()[i].Print(stream);
+    }
+
+    stream << " }";
 }
 
-size_t ArrayNode::ConvertBigIntegerToSizeT(const BigInteger& value) const
+VmNode* VmValue::Node() const
 {
-    if (value >= BigInteger(Size())) {
-        throw std::runtime_error("index out of range while accessing array");
+    switch (_type) {
+    case VALUE_TYPE_BIG_INTEGER:
+        return _big;
+    case VALUE_TYPE_ARRAY:
+        return _array;
+    case VALUE_TYPE_RECORD:
+        return _record;
+    default:
+        return nullptr;
     }
+}
 
-    return stoi(value.Value());
-};
+void VmValue::Print(std::ostream& stream) const
+{
+    switch (_type) {
+    case VALUE_TYPE_BIG_INTEGER:
+        _big->Print(stream);
+        break;
+    case VALUE_TYPE_ARRAY:
+        _array->Print(stream);
+        break;
+    case VALUE_TYPE_RECORD:
+        _record->Print(stream);
+        break;
+    default:
+        stream << _small;
+        break;
+    }
+}
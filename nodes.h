@@ -1,137 +1,177 @@
 #pragma once
 
+#include <iosfwd>
 #include <stdexcept>
 
 #include "bigint.h"
 #include "vm_definitions.h"
+#include "zero_filled_array.h"
 
+// Integer outside of the int64_t range. Smaller integers live inline in
+// VmValue.
 class IntegerNode : public VmNode {
 public:
-    IntegerNode(int value);
-
-    IntegerNode(const std::string& value);
-
     IntegerNode(BigInteger value);
 
-    ~IntegerNode() override = default;
+    ~IntegerNode() = default;
 
 public:
-    VmNodeType GetNodeType() const override;
+    void Print(std::ostream& stream) const;
 
-    std::string Value() const override;
+    const BigInteger& RealValue() const;
 
-    std::shared_ptr<VmNode> Negate() override;
+    // Only for temporaries, which nothing else can observe.
+    BigInteger& MutableValue();
 
-    BigInteger RealValue() const;
+private:
+    BigInteger _value;
+};
 
+// Arrays start out dense: as long as every element is a small integer they
+// are stored as plain int64_t, 8 bytes per element with nothing for the
+// collector to trace. The first store of anything else converts the array to
+// general VmValue cells for good. Both kinds of storage start as zero bytes,
+// which read as integer 0, so creating an array does not touch its elements.
+class ArrayNode : public VmNode {
 public:
-    std::shared_ptr<VmNode> operator+(const VmNode& other) const override;
+    ArrayNode(size_t size);
 
-    std::shared_ptr<VmNode> operator-(const VmNode& other) const override;
+    // Slice: a view of elements [offset, offset + size) of the array, sharing
+    // its storage. A slice of a slice refers to the original array directly.
+    ArrayNode(ArrayNode* array, size_t offset, size_t size);
 
-    std::shared_ptr<VmNode> operator*(const VmNode& other) const override;
-
-    std::shared_ptr<VmNode> operator/(const VmNode& other) const override;
-
-    std::shared_ptr<VmNode> operator%(const VmNode& other) const override;
+    ~ArrayNode() = default;
 
 public:
-    bool operator<(const VmNode& other) const override;
-
-    bool operator>(const VmNode& other) const override;
+    void Print(std::ostream& stream) const;
 
-    bool operator<=(const VmNode& other) const override;
+    size_t Size() const { return _size; }
 
-    bool operator>=(const VmNode& other) const override;
+    // Only for arrays that are not slices.
+    bool IsDense() const { return _dense; }
 
-    bool operator!=(const VmNode& other) const override;
+    bool IsSlice() const { return _base != nullptr; }
 
-    bool operator==(const VmNode& other) const override;
+    // Array whose storage the slice uses, nullptr for other arrays.
+    ArrayNode* Base() const { return _base; }
 
-private:
-    BigInteger _value;
-};
-
-class ArrayNode : public VmNode {
 public:
-    ArrayNode(size_t size, Frame& frame);
+    VmValue Get(const VmValue& index) const;
+    size_t Set(const VmValue& index, const VmValue& value);
 
-    ~ArrayNode() override = default;
-
-public:
-    std::shared_ptr<VmNode> Negate() override
+    VmValue Get(size_t index) const
     {
-        throw std::runtime_error("bad operation with array");
-    };
+        if (_base != nullptr) {
+            return _base->Get(_offset + index);
+        }
 
-public:
-    std::shared_ptr<VmNode> operator+(const VmNode& other) const override
-    {
-        throw std::runtime_error("bad operation with array");
+        return _dense ? VmValue(_integers[index]) : _values[index];
     }
 
-    std::shared_ptr<VmNode> operator-(const VmNode& other) const override
+    // Returns the bytes of storage that the store backed for the first time,
+    // see ZeroFilledArray.
+    size_t Set(size_t index, const VmValue& value)
     {
-        throw std::runtime_error("bad operation with array");
-    }
+        if (_base != nullptr) {
+            return _base->Set(_offset + index, value);
+        }
 
-    std::shared_ptr<VmNode> operator*(const VmNode& other) const override
-    {
-        throw std::runtime_error("bad operation with array");
-    }
+        if (_dense && value.IsSmall()) {
+            return _integers.Store(index, value.Small());
+        }
 
-    std::shared_ptr<VmNode> operator/(const VmNode& other) const override
-    {
-        throw std::runtime_error("bad operation with array");
-    }
+        size_t backed = 0;
 
-    std::shared_ptr<VmNode> operator%(const VmNode& other) const override
-    {
-        throw std::runtime_error("bad operation with array");
-    }
+        if (_dense) {
+            backed = MakeGeneral();
+        }
 
-public:
-    bool operator<(const VmNode& other) const override
-    {
-        throw std::runtime_error("bad operation with array");
+        return backed + _values.Store(index, value);
     }
 
-    bool operator>(const VmNode& other) const override
+    // Storage in use, only the parts written to for large arrays. Only for
+    // arrays that are not slices.
+    size_t BackedBytes() const
     {
-        throw std::runtime_error("bad operation with array");
+        return _dense ? _integers.BackedBytes() : _values.BackedBytes();
     }
 
-    bool operator<=(const VmNode& other) const override
+    // Calls the function with every element that may be other than zero.
+    // Only for arrays that are not dense.
+    template <typename Function>
+    void ForEachWritten(Function function) const
     {
-        throw std::runtime_error("bad operation with array");
+        _values.ForEachWritten(
+            [&](size_t, const VmValue& value) { function(value); });
     }
 
-    bool operator>=(const VmNode& other) const override
+    // Checks that the value is a valid index into the array.
+    size_t ConvertIndexToSizeT(const VmValue& value) const;
+
+    // Checks that the value is a valid bound of a slice, from 0 to Size().
+    size_t ConvertBoundToSizeT(const VmValue& value) const;
+
+    // For stores that have to go through the heap's write barrier. Only for
+    // arrays that are not dense.
+    VmValue& Cell(size_t index)
     {
-        throw std::runtime_error("bad operation with array");
+        return _base != nullptr ? _base->Cell(_offset + index)
+                                : _values.Cell(index);
     }
 
-    bool operator!=(const VmNode& other) const override;
+private:
+    // Returns the bytes backed by the general storage.
+    size_t MakeGeneral();
 
-    bool operator==(const VmNode& other) const override;
+private:
+    size_t _size;
+    ArrayNode* _base = nullptr;
+    size_t _offset = 0;
+    bool _dense = true;
+    ZeroFilledArray<int64_t> _integers;
+    ZeroFilledArray<VmValue> _values;
+};
 
+// Fields are kept inline, right after the node in the same allocation, so a
+// record costs one allocation whatever its size. Use Create() instead of new.
+class RecordNode : public VmNode {
 public:
-    VmNodeType GetNodeType() const override;
+    // Bytes of the node with its fields.
+    static size_t AllocationSize(const RecordLayout* layout);
 
-    std::string Value() const override;
+    // Constructs the record in memory of AllocationSize(layout) bytes.
+    static RecordNode* Create(const RecordLayout* layout, void* memory);
 
-    size_t Size() const;
+    ~RecordNode() = default;
 
 public:
-    const std::weak_ptr<VmNode>& Get(const BigInteger& index) const;
-    void Set(const BigInteger& index, std::weak_ptr<VmNode> value);
+    void Print(std::ostream& stream) const;
 
-    const std::weak_ptr<VmNode>& Get(size_t index) const;
-    void Set(size_t index, std::weak_ptr<VmNode> value);
+    const RecordLayout* Layout() const { return _layout; }
+
+    size_t Size() const { return _layout->fields.size(); }
+
+    bool HasField(int offset, int fieldName) const
+    {
+        return static_cast<size_t>(offset) < Size()
+            && _layout->fieldNames[offset] == fieldName;
+    }
+
+    VmValue& Field(int offset) { return Fields()[offset]; }
+
+    // Offset of the interned field name in the layout, -1 if it has none.
+    int FindField(int fieldName) const;
 
 private:
-    size_t ConvertBigIntegerToSizeT(const BigInteger& value) const;
+    explicit RecordNode(const RecordLayout* layout);
+
+    VmValue* Fields() { return reinterpret_cast<VmValue*>(this + 1); }
+
+    const VmValue* Fields() const
+    {
+        return reinterpret_cast<const VmValue*>(this + 1);
+    }
 
 private:
-    std::vector<std::weak_ptr<VmNode>> _value;
+    const RecordLayout* _layout;
 };
@@ -22,6 +22,7 @@ int yyerror(const char* s);
 
 std::map<int, int> sym;
 std::vector<std::string> functionParameters;
+std::vector<std::string> recordFields;
 std::vector<nodeType*> functionArgs;
 std::vector<nodeType*> returnList;
 std::vector<nodeType*> variableList;
@@ -47,6 +48,7 @@ extern bool CheckExtension(const std::string& filename);
 %token <sIndex> VARIABLE
 %token LENGTH
 %token FOR WHILE IF PRINT LET FUNCTION CALL RETURN ARRAY ACCESS MASSIGN
+%token RECORD GET_FIELD SLICE DISCARD
 %nonassoc IFX
 %nonassoc ELSE
 
@@ -67,8 +69,22 @@ program:
 function:
         // | function stmt                   { ex($2); freeNode($2); }
         | function function_declaration
+        | function record_declaration
         ;
 
+record_declaration:
+                  RECORD VARIABLE '{' field_list '}'
+                  {
+                      DeclareRecord(yylValToToken[$2], recordFields);
+                      recordFields.clear();
+                  }
+                  ;
+
+field_list:
+          field_list ',' VARIABLE { recordFields.push_back(yylValToToken[$3]); }
+          | VARIABLE              { recordFields = std::vector<std::string>{yylValToToken[$1]}; }
+          ;
+
 function_declaration:
                     FUNCTION VARIABLE '(' parameter_list ')' '{' stmt_list '}'
                     {
@@ -81,6 +97,7 @@ function_declaration:
                         ex($7);
                         freeNode($7);
                         functionParameters.clear();
+                        recordVariables.clear();
                         *outputPtr << "\treturn\t0\n";
                     }
                     ;
@@ -97,12 +114,14 @@ parameter_list:
 
 stmt:
     ';'                                                                           { $$ = opr(';', 2, NULL, NULL); }
-    | expr ';'                                                                    { $$ = $1; }
+    | expr ';'                                                                    { $$ = opr(DISCARD, 1, $1); }
     | LET VARIABLE '=' expr ';'                                                   { $$ = opr('=', 2, id($2), $4); }
     | ARRAY VARIABLE '[' expr ']' ';'                                             { $$ = opr(ARRAY, 2, id($2), $4); }
+    | RECORD VARIABLE VARIABLE ';'                                                { $$ = opr(RECORD, 2, id($2), id($3)); }
     | PRINT expr ';'                                                              { $$ = opr(PRINT, 1, $2); }
     | VARIABLE '=' expr ';'                                                       { $$ = opr('=', 2, id($1), $3); }
     | VARIABLE '[' expr ']' '=' expr ';'                                          { $$ = opr('=', 3, id($1), $3, $6); }
+    | VARIABLE '.' VARIABLE '=' expr ';'                                          { $$ = opr('.', 3, id($1), id($3), $5); }
     | multiple_assignment ';'                                                     { $$ = $1; }
     | RETURN return_list ';'                                                      { $$ = opr(RETURN, 1, returnList); }
     | WHILE '(' expr ')' '{' stmt_list '}'                                        { $$ = opr(WHILE, 2, $3, $6); }
@@ -146,6 +165,8 @@ expr:
     | LENGTH '(' VARIABLE ')'              { $$ = opr(LENGTH, 1, id($3)); }
     | VARIABLE '(' arg_list ')'            { $$ = opr(CALL, 2, id($1), $3); }             
     | VARIABLE '[' expr ']'                { $$ = opr(ACCESS, 2, id($1), $3); }
+    | VARIABLE '[' expr ':' expr ']'       { $$ = opr(SLICE, 3, id($1), $3, $5); }
+    | VARIABLE '.' VARIABLE                { $$ = opr(GET_FIELD, 2, id($1), id($3)); }
     | '-' expr %prec UMINUS                { $$ = opr(UMINUS, 1, $2); }
     | expr '+' expr                        { $$ = opr('+', 2, $1, $3); }
     | expr '-' expr                        { $$ = opr('-', 2, $1, $3); }
@@ -257,24 +278,68 @@ int yyerror(const char* s) {
 }
 
 int main(int argc, char** argv) {
-    if (argc == 1) {
+    std::vector<std::string> arguments;
+    HeapOptions heapOptions;
+    VmKind vmKind = VM_STACK;
+
+    // Options look like --name=value and may appear anywhere, the rest are
+    // the input and output files.
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument.rfind("--", 0) != 0) {
+            arguments.push_back(argument);
+            continue;
+        }
+
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(0, separator);
+        std::string value =
+            separator == std::string::npos ? "" : argument.substr(separator + 1);
+
+        if (name == "--heap-threshold") {
+            heapOptions.initialThreshold = std::stoul(value);
+        } else if (name == "--heap-growth") {
+            heapOptions.growthFactor = std::stod(value);
+
+            if (heapOptions.growthFactor < 1) {
+                throw std::runtime_error("heap growth should be at least 1");
+            }
+        } else if (name == "--heap-nursery") {
+            heapOptions.nurseryBytes = std::stoul(value);
+        } else if (name == "--heap-promotion-age") {
+            heapOptions.promotionAge = std::stoul(value);
+        } else if (name == "--vm") {
+            if (value == "stack") {
+                vmKind = VM_STACK;
+            } else if (value == "register") {
+                vmKind = VM_REGISTER;
+            } else {
+                throw std::runtime_error("vm should be stack or register");
+            }
+        } else {
+            throw std::runtime_error("unknown option " + argument);
+        }
+    }
+
+    if (arguments.empty()) {
         throw std::runtime_error("provide an input file");
     }
 
-    std::string converted = std::string(argv[1]);
+    std::string converted = arguments[0];
 
     if (!std::filesystem::exists(converted)) {
         throw std::runtime_error("input file does not exist");
     }
 
-    std::string mergedFile = std::string(argv[1]) + "_processed";
+    std::string mergedFile = arguments[0] + "_processed";
     assert(yyin == NULL);
     
     ProcessImports(converted);
     yyin = fopen(mergedFile.c_str(), "r");
 
-    if (argc >= 3) {
-        outputFile = std::string(argv[2]);
+    if (arguments.size() >= 2) {
+        outputFile = arguments[1];
         outputPtr = new std::ofstream(outputFile);
     }
 
@@ -282,7 +347,7 @@ int main(int argc, char** argv) {
         yyparse();
         closeStreams();
 
-        VirtualMachine vm;
+        VirtualMachine vm(heapOptions, vmKind);
         vm.Run();
     } catch (std::exception& e) {
         std::cerr << e.what() << "\n";
@@ -0,0 +1,226 @@
+// Checks every limb kernel set the CPU supports against the scalar one.
+//
+//     make test
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../bigint_kernels.h"
+
+namespace {
+
+using Limbs = std::vector<uint32_t>;
+
+// Sets that exist on some CPUs, reported when this one cannot run them.
+const char* const KNOWN_KERNELS[] = { "sse2", "avx2" };
+
+// Longer than a few 256-bit blocks, so that every length modulo the vector
+// widths shows up with and without a scalar tail.
+constexpr size_t MAX_SIZE = 41;
+
+std::mt19937 rng(42);
+size_t failures = 0;
+
+void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+Limbs Random(size_t size) {
+    Limbs result(size);
+
+    for (uint32_t& limb : result) {
+        limb = rng();
+    }
+
+    return result;
+}
+
+// Pairs of operands of the given size that exercise carries, borrows and
+// comparisons limb by limb.
+std::vector<std::pair<Limbs, Limbs>> Cases(size_t size) {
+    std::vector<std::pair<Limbs, Limbs>> cases;
+
+    for (int i = 0; i < 4; ++i) {
+        cases.emplace_back(Random(size), Random(size));
+    }
+
+    Limbs zeros(size, 0);
+    Limbs ones(size, 0xFFFFFFFFu);
+    Limbs one(size, 0);
+    Limbs oneAtTop(size, 0);
+
+    if (size != 0) {
+        one[0] = 1;
+        oneAtTop.back() = 1;
+    }
+
+    // A carry that runs through every limb, and all ones plus all ones.
+    cases.emplace_back(ones, one);
+    cases.emplace_back(ones, ones);
+
+    // A borrow that runs through zero limbs up to the top one.
+    cases.emplace_back(oneAtTop, one);
+    cases.emplace_back(zeros, one);
+    cases.emplace_back(zeros, ones);
+    cases.emplace_back(zeros, zeros);
+
+    // Operands that differ in a single limb, low, middle or top, either way,
+    // and fully equal operands.
+    for (size_t position : { size_t(0), size / 2, size - 1 }) {
+        if (position >= size) {
+            continue;
+        }
+
+        Limbs lhs = Random(size);
+        Limbs rhs = lhs;
+        rhs[position] ^= 1u << (rng() % 32);
+
+        cases.emplace_back(lhs, rhs);
+        cases.emplace_back(rhs, lhs);
+    }
+
+    Limbs same = Random(size);
+    cases.emplace_back(same, same);
+
+    return cases;
+}
+
+void CheckKernels(const LimbKernels& reference, const LimbKernels& kernels) {
+    for (size_t size = 0; size <= MAX_SIZE; ++size) {
+        for (const auto& [lhs, rhs] : Cases(size)) {
+            std::string what = std::string(kernels.name) + " vs " +
+                               reference.name + ", " + std::to_string(size) +
+                               " limbs: ";
+
+            Limbs expected(size);
+            Limbs actual(size);
+
+            uint32_t expectedCarry =
+                reference.add(lhs.data(), rhs.data(), expected.data(), size);
+            uint32_t carry =
+                kernels.add(lhs.data(), rhs.data(), actual.data(), size);
+
+            Check(actual == expected, what + "add limbs");
+            Check(carry == expectedCarry, what + "add carry");
+
+            // The result may also be the lhs range.
+            Limbs inPlace = lhs;
+            carry = kernels.add(inPlace.data(), rhs.data(), inPlace.data(),
+                                size);
+
+            Check(inPlace == expected, what + "add in place limbs");
+            Check(carry == expectedCarry, what + "add in place carry");
+
+            uint32_t expectedBorrow = reference.subtract(
+                lhs.data(), rhs.data(), expected.data(), size);
+            uint32_t borrow =
+                kernels.subtract(lhs.data(), rhs.data(), actual.data(), size);
+
+            Check(actual == expected, what + "subtract limbs");
+            Check(borrow == expectedBorrow, what + "subtract borrow");
+
+            // Or either operand for subtraction.
+            inPlace = lhs;
+            borrow = kernels.subtract(inPlace.data(), rhs.data(),
+                                      inPlace.data(), size);
+
+            Check(inPlace == expected, what + "subtract into lhs limbs");
+            Check(borrow == expectedBorrow, what + "subtract into lhs borrow");
+
+            inPlace = rhs;
+            borrow = kernels.subtract(lhs.data(), inPlace.data(),
+                                      inPlace.data(), size);
+
+            Check(inPlace == expected, what + "subtract into rhs limbs");
+            Check(borrow == expectedBorrow, what + "subtract into rhs borrow");
+
+            Check(kernels.compare(lhs.data(), rhs.data(), size) ==
+                      reference.compare(lhs.data(), rhs.data(), size),
+                  what + "compare");
+        }
+    }
+}
+
+// The scalar kernels are the reference for the others, so they are checked
+// against plain arithmetic on single limbs first.
+void CheckScalar(const LimbKernels& scalar) {
+    for (size_t size = 0; size <= MAX_SIZE; ++size) {
+        for (const auto& [lhs, rhs] : Cases(size)) {
+            std::string what = "scalar, " + std::to_string(size) + " limbs: ";
+
+            Limbs sum(size);
+            Limbs difference(size);
+            uint64_t carry = 0;
+            uint64_t borrow = 0;
+            int comparison = 0;
+
+            for (size_t i = 0; i < size; ++i) {
+                uint64_t total = uint64_t(lhs[i]) + rhs[i] + carry;
+                sum[i] = static_cast<uint32_t>(total);
+                carry = total >> 32;
+
+                uint64_t rest = uint64_t(lhs[i]) - rhs[i] - borrow;
+                difference[i] = static_cast<uint32_t>(rest);
+                borrow = rest >> 63;
+
+                if (lhs[i] != rhs[i]) {
+                    comparison = lhs[i] < rhs[i] ? -1 : 1;
+                }
+            }
+
+            Limbs actual(size);
+
+            Check(scalar.add(lhs.data(), rhs.data(), actual.data(), size) ==
+                          carry &&
+                      actual == sum,
+                  what + "add");
+            Check(scalar.subtract(lhs.data(), rhs.data(), actual.data(),
+                                  size) == borrow &&
+                      actual == difference,
+                  what + "subtract");
+            Check(scalar.compare(lhs.data(), rhs.data(), size) == comparison,
+                  what + "compare");
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    const std::vector<const LimbKernels*>& available = AvailableLimbKernels();
+    const LimbKernels& scalar = *available.front();
+
+    CheckScalar(scalar);
+
+    for (size_t i = 1; i < available.size(); ++i) {
+        CheckKernels(scalar, *available[i]);
+    }
+
+    for (const char* name : KNOWN_KERNELS) {
+        bool found = false;
+
+        for (const LimbKernels* kernels : available) {
+            found |= name == std::string(kernels->name);
+        }
+
+        if (!found) {
+            std::printf("bigint_kernels_test: %s not supported, skipped\n",
+                        name);
+        }
+    }
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%zu checks failed\n", failures);
+        return 1;
+    }
+
+    std::printf("bigint_kernels_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+// Checks BigInteger against simpler ways of computing the same results.
+//
+//     make test
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../bigint.h"
+
+namespace {
+
+using Thresholds = BigInteger::MultiplicationThresholds;
+
+constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+
+// Thresholds that leave only the schoolbook algorithm.
+const Thresholds SCHOOLBOOK = { NEVER, NEVER };
+
+std::mt19937 rng(42);
+size_t failures = 0;
+
+void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// Builds a number from little-endian limbs. Only single-limb multiplications
+// are involved, which are schoolbook whatever the thresholds are.
+BigInteger FromLimbs(const std::vector<uint32_t>& limbs, bool negative) {
+    const BigInteger base(int64_t(1) << 32);
+    BigInteger result;
+
+    for (size_t i = limbs.size(); i-- > 0;) {
+        result = result * base + BigInteger(int64_t(limbs[i]));
+    }
+
+    if (negative) {
+        result.Negate();
+    }
+
+    return result;
+}
+
+// Operands of exactly size limbs in a few shapes that stress carries.
+std::vector<BigInteger> Operands(size_t size) {
+    std::vector<uint32_t> random(size);
+    std::vector<uint32_t> ones(size, 0xFFFFFFFFu);
+    std::vector<uint32_t> power(size, 0);
+    power.back() = 1;
+
+    for (uint32_t& limb : random) {
+        limb = rng();
+    }
+
+    random.back() |= 1;
+
+    return {
+        FromLimbs(random, false),
+        FromLimbs(random, true),
+        FromLimbs(ones, false),
+        FromLimbs(power, true),
+    };
+}
+
+// Multiplies every pair of operand shapes with the given thresholds and
+// compares against the schoolbook product.
+void CheckProducts(const char* path, const Thresholds& thresholds,
+                   size_t lhsSize, size_t rhsSize) {
+    std::vector<BigInteger> lhs = Operands(lhsSize);
+    std::vector<BigInteger> rhs = Operands(rhsSize);
+
+    for (const BigInteger& a : lhs) {
+        for (const BigInteger& b : rhs) {
+            BigInteger::SetMultiplicationThresholds(SCHOOLBOOK);
+            BigInteger expected = a * b;
+
+            BigInteger::SetMultiplicationThresholds(thresholds);
+            BigInteger product = a * b;
+            BigInteger compound = a;
+            compound *= b;
+
+            std::string what = std::string(path) + " " +
+                               std::to_string(lhsSize) + "x" +
+                               std::to_string(rhsSize) + " limbs";
+
+            Check(product == expected, what);
+            Check(compound == expected, what + ", *=");
+        }
+    }
+
+    BigInteger::SetMultiplicationThresholds(SCHOOLBOOK);
+}
+
+void TestMultiplication() {
+    // Low thresholds keep the operands small. The smaller operand decides
+    // the algorithm, sizes are taken at and around each cutoff, balanced
+    // and unbalanced.
+    const size_t karatsuba = 8;
+    const size_t toom3 = 24;
+
+    const Thresholds karatsubaOnly = { karatsuba, NEVER };
+    const Thresholds all = { karatsuba, toom3 };
+
+    for (size_t size : { size_t(1), size_t(2), karatsuba - 1 }) {
+        CheckProducts("schoolbook", all, size, size);
+        CheckProducts("schoolbook", all, 3 * karatsuba, size);
+    }
+
+    for (size_t size : { karatsuba, karatsuba + 1, toom3 - 1 }) {
+        CheckProducts("karatsuba", all, size, size);
+        CheckProducts("karatsuba", all, size + 1, size);
+        CheckProducts("karatsuba", all, 2 * size - 1, size);
+        CheckProducts("karatsuba, unbalanced", all, 2 * size, size);
+        CheckProducts("karatsuba only", karatsubaOnly, 5 * size, 5 * size);
+    }
+
+    for (size_t size : { toom3, toom3 + 1, toom3 + 2, 3 * toom3 + 1 }) {
+        CheckProducts("toom-3", all, size, size);
+        CheckProducts("toom-3", all, size + 1, size);
+        CheckProducts("toom-3", all, 2 * size - 1, size);
+        CheckProducts("toom-3, unbalanced", all, 2 * size + 1, size);
+    }
+
+    // The defaults, which the other cases do not reach.
+    Thresholds defaults;
+
+    for (size_t size : { defaults.karatsuba, defaults.toom3,
+                         defaults.toom3 + 7 }) {
+        CheckProducts("default thresholds", defaults, size, size);
+    }
+}
+
+// Checks a division against its definition: the remainder is smaller than
+// the divisor in magnitude, has the divisor's sign and makes up the rest of
+// the dividend. Only one quotient satisfies all of that.
+void CheckDivision(const BigInteger& a, const BigInteger& b,
+                   const std::string& what) {
+    auto [quotient, remainder] = a.DivMod(b);
+    BigInteger lower = b;
+    BigInteger upper = b;
+
+    if (b.IsNegative()) {
+        upper.Negate();
+    } else {
+        lower.Negate();
+    }
+
+    Check(quotient * b + remainder == a, what + ", a = q * b + r");
+    Check(remainder.IsZero() || remainder.IsNegative() == b.IsNegative(),
+          what + ", sign of r");
+    Check(lower < remainder && remainder < upper, what + ", |r| < |b|");
+    Check(a / b == quotient, what + ", operator/");
+    Check(a % b == remainder, what + ", operator%");
+}
+
+int64_t FloorDivide(int64_t a, int64_t b) {
+    int64_t quotient = a / b;
+
+    if (a % b != 0 && (a < 0) != (b < 0)) {
+        --quotient;
+    }
+
+    return quotient;
+}
+
+void TestDivision() {
+    // Floor semantics against the built-in integers for every sign mix, with
+    // and without a remainder.
+    const int64_t small[] = { 0, 1, 2, 3, 7, 10, 4294967295, 4294967296 };
+
+    for (int64_t a : small) {
+        for (int64_t b : small) {
+            if (b == 0) {
+                continue;
+            }
+
+            for (int64_t sa : { 1, -1 }) {
+                for (int64_t sb : { 1, -1 }) {
+                    int64_t lhs = sa * a;
+                    int64_t rhs = sb * b;
+                    int64_t quotient = FloorDivide(lhs, rhs);
+                    auto [q, r] = BigInteger(lhs).DivMod(BigInteger(rhs));
+                    std::string what = std::to_string(lhs) + " / " +
+                                       std::to_string(rhs);
+
+                    Check(q == BigInteger(quotient), what + ", quotient");
+                    Check(r == BigInteger(lhs - quotient * rhs),
+                          what + ", remainder");
+                }
+            }
+        }
+    }
+
+    // Quotient digits that are estimated one too big and need the divisor
+    // added back, from Hacker's Delight's tests of Knuth's algorithm D.
+    const std::vector<std::pair<std::vector<uint32_t>, std::vector<uint32_t>>>
+        addBack = {
+            { { 0, 0, 0x80000000u, 0x7FFFFFFFu }, { 1, 0, 0x80000000u } },
+            { { 3, 0, 0x80000000u }, { 1, 0, 0x20000000u } },
+            { { 0, 0, 0x8000u, 0x7FFFu }, { 1, 0, 0x8000u } },
+        };
+
+    for (const auto& [lhs, rhs] : addBack) {
+        for (bool negative : { false, true }) {
+            CheckDivision(FromLimbs(lhs, negative), FromLimbs(rhs, false),
+                          "add back");
+            CheckDivision(FromLimbs(lhs, false), FromLimbs(rhs, negative),
+                          "add back");
+        }
+    }
+
+    // Single-limb divisors take a shortcut, longer ones go through the full
+    // algorithm. Every operand shape and sign is paired up, including
+    // dividends shorter than the divisor.
+    for (size_t lhsSize : { 1, 2, 3, 5, 17, 40 }) {
+        for (size_t rhsSize : { 1, 2, 3, 16 }) {
+            std::string what = std::to_string(lhsSize) + " / " +
+                               std::to_string(rhsSize) + " limbs";
+
+            for (const BigInteger& a : Operands(lhsSize)) {
+                for (const BigInteger& b : Operands(rhsSize)) {
+                    CheckDivision(a, b, what);
+                }
+            }
+        }
+    }
+
+    bool thrown = false;
+
+    try {
+        BigInteger(1).DivMod(BigInteger());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+
+    Check(thrown, "division by zero throws");
+}
+
+// Value() splits by powers of ten and divides through their reciprocals,
+// parsing joins by multiplication, so a round trip checks one against the
+// other. Nines and powers of ten sit right at the split points.
+void TestDecimal() {
+    std::vector<size_t> sizes = { 1, 9, 10, 299, 300, 301, 310 };
+
+    for (size_t size = 577; size <= 80'000; size = size * 2 + 1) {
+        sizes.push_back(size);
+    }
+
+    for (size_t size : sizes) {
+        std::string random(1, static_cast<char>('1' + rng() % 9));
+
+        while (random.size() < size) {
+            random.push_back(static_cast<char>('0' + rng() % 10));
+        }
+
+        std::string nines(size, '9');
+        std::string power = "1" + std::string(size, '0');
+
+        for (const std::string& digits : { random, nines, power }) {
+            std::string what = "decimal round trip of " +
+                               std::to_string(digits.size()) + " digits";
+
+            Check(BigInteger(digits, false).Value() == digits, what);
+            Check(BigInteger(digits, true).Value() == "-" + digits, what);
+
+            std::ostringstream printed;
+            BigInteger(digits, true).Print(printed);
+
+            Check(printed.str() == "-" + digits, what + ", Print");
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    const Thresholds original = BigInteger::GetMultiplicationThresholds();
+
+    TestMultiplication();
+
+    BigInteger::SetMultiplicationThresholds(original);
+
+    TestDivision();
+    TestDecimal();
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%zu checks failed\n", failures);
+        return 1;
+    }
+
+    std::printf("bigint_test: all checks passed\n");
+    return 0;
+}
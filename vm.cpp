@@ -2,6 +2,8 @@
 #include <cctype>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <stack>
 #include <stdexcept>
@@ -10,7 +12,9 @@
 #include <utility>
 #include <vector>
 
+#include "bigint.h"
 #include "definitions.h"
+#include "integer.h"
 #include "nodes.h"
 #include "vm_definitions.h"
 
@@ -41,6 +45,11 @@ std::unordered_map<std::string, VmInstructionType> strToInstruction = {
     { "length", TYPE_LENGTH },
     { "binAND", TYPE_BIN_AND },
     { "binOR", TYPE_BIN_OR },
+    { "record", TYPE_RECORD },
+    { "getField", TYPE_GET_FIELD },
+    { "setField", TYPE_SET_FIELD },
+    { "slice", TYPE_SLICE },
+    { "discard", TYPE_DISCARD },
 };
 
 std::unordered_map<VmInstructionType, std::string> instructionTypeToStr = {
@@ -68,6 +77,11 @@ std::unordered_map<VmInstructionType, std::string> instructionTypeToStr = {
     { TYPE_LENGTH, "length" },
     { TYPE_BIN_AND, "binAND" },
     { TYPE_BIN_OR, "binOR" },
+    { TYPE_RECORD, "record" },
+    { TYPE_GET_FIELD, "getField" },
+    { TYPE_SET_FIELD, "setField" },
+    { TYPE_SLICE, "slice" },
+    { TYPE_DISCARD, "discard" },
 };
 
 std::vector<std::string> split(const std::string& str, char delimeter = ' ')
@@ -105,29 +119,6 @@ Instruction& Instruction::fromString(const std::string& instruction)
     return *this;
 };
 
-void RescueArray(Frame& frame, std::shared_ptr<VmNode> node)
-{
-    /*std::cout << "here\n";*/
-    /**/
-    /*for (const auto& o : frame.objects) {*/
-    /*    std::cout << o->GetNodeType() << " " << o->Value() << "\n";*/
-    /*}*/
-    /**/
-    /*std::cout << "======\n";*/
-
-    if (node->GetNodeType() == NODE_TYPE_ARRAY) {
-        std::shared_ptr<ArrayNode> casted = std::static_pointer_cast<ArrayNode>(node);
-
-        for (int i = 0; i < casted->Size(); i++) {
-            std::shared_ptr<VmNode> toSave = casted->Get(i).lock();
-            frame.objects.push_back(toSave);
-
-            // If the value is also array, rescue it recursively.
-            RescueArray(frame, toSave);
-        }
-    }
-}
-
 void PrintOptimizedIR(const std::vector<Instruction>& instructions,
     const std::unordered_map<std::string, int>& marks)
 {
@@ -159,14 +150,29 @@ void PrintOptimizedIR(const std::vector<Instruction>& instructions,
     }
 }
 
+VirtualMachine::VirtualMachine(HeapOptions heapOptions, VmKind kind)
+    : _heap(heapOptions)
+    , _kind(kind)
+{
+}
+
 void VirtualMachine::Run()
 {
     ReadInstructions();
     Optimize();
+    BuildConstantPool();
+    ResolveRecords();
+    Lower();
+    Verify();
 
     PrintOptimizedIR(_instructions, _marks);
 
-    Execute();
+    if (_kind == VM_REGISTER) {
+        LowerToRegisters();
+        ExecuteRegisters();
+    } else {
+        Execute();
+    }
 }
 
 void VirtualMachine::ReadInstructions()
@@ -227,7 +233,7 @@ bool IsNumber(const std::string& str)
 }
 
 struct ConstantFoldingStackValue {
-    std::shared_ptr<IntegerNode> value;
+    Integer value;
     bool isConstant;
 };
 
@@ -263,10 +269,9 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             const std::string& arg = instruction.arguments[0];
 
             if (IsNumber(arg)) {
-                stack.push_back({ std::make_shared<IntegerNode>(arg), true });
+                stack.push_back({ Integer(arg), true });
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -284,14 +289,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                std::shared_ptr<VmNode> result = *lhs.value.get() + *rhs.value.get();
+                Integer result = lhs.value + rhs.value;
 
-                stack.push_back(
-                    { std::static_pointer_cast<IntegerNode>(result), true });
+                stack.push_back({ result, true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -309,14 +312,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                std::shared_ptr<VmNode> result = *lhs.value.get() - *rhs.value.get();
+                Integer result = lhs.value - rhs.value;
 
-                stack.push_back(
-                    { std::static_pointer_cast<IntegerNode>(result), true });
+                stack.push_back({ result, true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -334,14 +335,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                std::shared_ptr<VmNode> result = *lhs.value.get() * *rhs.value.get();
+                Integer result = lhs.value * rhs.value;
 
-                stack.push_back(
-                    { std::static_pointer_cast<IntegerNode>(result), true });
+                stack.push_back({ result, true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -359,14 +358,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                std::shared_ptr<VmNode> result = *lhs.value.get() / *rhs.value.get();
+                Integer result = lhs.value / rhs.value;
 
-                stack.push_back(
-                    { std::static_pointer_cast<IntegerNode>(result), true });
+                stack.push_back({ result, true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -384,14 +381,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                std::shared_ptr<VmNode> result = *lhs.value.get() % *rhs.value.get();
+                Integer result = lhs.value % rhs.value;
 
-                stack.push_back(
-                    { std::static_pointer_cast<IntegerNode>(result), true });
+                stack.push_back({ result, true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -409,15 +404,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() == *rhs.value.get());
-
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
+                int result = (lhs.value == rhs.value);
 
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -435,15 +427,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() >= *rhs.value.get());
+                int result = (lhs.value >= rhs.value);
 
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
-
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -461,15 +450,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() > *rhs.value.get());
-
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
+                int result = (lhs.value > rhs.value);
 
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -487,15 +473,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() <= *rhs.value.get());
+                int result = (lhs.value <= rhs.value);
 
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
-
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -513,15 +496,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() < *rhs.value.get());
-
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
+                int result = (lhs.value < rhs.value);
 
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -539,15 +519,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = (*lhs.value.get() != *rhs.value.get());
+                int result = (lhs.value != rhs.value);
 
-                std::shared_ptr<IntegerNode> tempNode = std::make_shared<IntegerNode>(result);
-
-                stack.push_back({ tempNode, true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -565,14 +542,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = ((lhs.value.get()->Value() != "0") && (rhs.value.get()->Value() != "0"));
+                int result = (!lhs.value.IsZero() && !rhs.value.IsZero());
 
-                stack.push_back(
-                    { std::make_shared<IntegerNode>(result), true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -590,14 +565,12 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             stack.pop_back();
 
             if (lhs.isConstant && rhs.isConstant) {
-                int result = ((lhs.value.get()->Value() != "0") || (rhs.value.get()->Value() != "0"));
+                int result = (!lhs.value.IsZero() || !rhs.value.IsZero());
 
-                stack.push_back(
-                    { std::make_shared<IntegerNode>(result), true });
+                stack.push_back({ Integer(result), true });
                 deleted.push_back(i);
             } else {
-                stack.push_back(
-                    { std::make_shared<IntegerNode>("0"), false });
+                stack.push_back({ Integer(0), false });
             }
 
             break;
@@ -620,7 +593,7 @@ void ApplyConstantFolding(std::vector<Instruction>* instructionsPtr,
             deleted.push_back(index1);
             deleted.push_back(index2);
 
-            Instruction append = Instruction { TYPE_PUSH, { stack.back().value->Value() } };
+            Instruction append = Instruction { TYPE_PUSH, { stack.back().value.Value() } };
 
             optimized.push_back({ std::move(append), i });
         }
@@ -734,540 +707,2462 @@ void VirtualMachine::Optimize()
     RemoveDeadCode(&_instructions, &_marks);
 }
 
-void VirtualMachine::Execute()
+bool IsTruthy(const VmValue& value)
 {
-    int currentInstruction = _marks["entrypoint"];
+    // Arrays and records are never null and big integers are never zero.
+    return !value.IsSmall() || value.Small() != 0;
+}
 
-    _frames.push_back(std::move(Frame()));
+void CheckInteger(const VmValue& value)
+{
+    if (value.IsArray()) {
+        throw std::runtime_error("bad operation with array");
+    }
 
-    while (currentInstruction < _instructions.size()) {
-        const auto& instruction = _instructions[currentInstruction];
-        auto& frame = _frames.back();
+    if (value.IsRecord()) {
+        throw std::runtime_error("bad operation with record");
+    }
+}
 
-        switch (instruction.type) {
-        case TYPE_PUSH: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error(
-                    "push should have exactly one argument");
-            }
+void CheckIntegers(const VmValue& lhs, const VmValue& rhs,
+    const char* error)
+{
+    CheckInteger(lhs);
 
-            const std::string& arg = instruction.arguments[0];
+    if (!rhs.IsInteger()) {
+        throw std::runtime_error(error);
+    }
+}
 
-            if (IsNumber(arg)) {
-                frame.objects.push_back(std::make_shared<IntegerNode>(arg));
-                _values.push_back(frame.objects.back());
-            } else {
-                if (frame.variables.find(arg) == frame.variables.end()) {
-                    throw std::runtime_error("unknown variable: " + arg);
-                } else {
-                    _values.push_back(frame.variables.at(arg));
-                }
-            }
+const BigInteger& AsBigInteger(const VmValue& value, BigInteger& scratch)
+{
+    if (!value.IsSmall()) {
+        return value.Big()->RealValue();
+    }
 
-            break;
-        }
-        case TYPE_POP: {
-            if (instruction.arguments.size() < 1) {
-                throw std::runtime_error("pop needs at least 1 argument");
-            }
+    scratch = BigInteger(value.Small());
 
-            if (_values.empty()) {
-                throw std::runtime_error(
-                    "value stack is empty, nothing to pop");
-            }
+    return scratch;
+}
 
-            if (instruction.arguments.size() == 1) {
-                const std::string& arg = instruction.arguments[0];
+// Results that fit into int64_t are stored inline, only the rest gets a node.
+VmValue MakeInteger(Heap& heap, BigInteger value)
+{
+    if (value.FitsInt64()) {
+        return VmValue(value.ToInt64());
+    }
 
-                frame.variables[arg] = _values.back();
-                _values.pop_back();
-            } else {
-                // We are setting the value to array cell.
-                const std::string& arg = instruction.arguments[1];
+    return VmValue(heap.Allocate<IntegerNode>(std::move(value)));
+}
 
-                std::shared_ptr<IntegerNode> index = std::static_pointer_cast<IntegerNode>(
-                    _values.back().lock());
-                _values.pop_back();
+VmValue MakeInteger(Heap& heap, const Integer& value)
+{
+    if (value.IsSmall()) {
+        return VmValue(value.Small());
+    }
 
-                std::shared_ptr<VmNode> value = _values.back().lock();
-                _values.pop_back();
+    return VmValue(heap.Allocate<IntegerNode>(value.ToBigInteger()));
+}
 
-                std::shared_ptr<ArrayNode> arrayNode = std::static_pointer_cast<ArrayNode>(
-                    frame.variables[arg].lock());
+// Two inline operands go through Integer, which catches int64_t overflow.
+// Anything bigger is computed on BigInteger directly.
+template <typename Operation>
+VmValue Calculate(Heap& heap, const VmValue& lhs, const VmValue& rhs,
+    Operation operation)
+{
+    if (lhs.IsSmall() && rhs.IsSmall()) {
+        return MakeInteger(
+            heap, operation(Integer(lhs.Small()), Integer(rhs.Small())));
+    }
 
-                arrayNode->Set(index->RealValue(), value);
-            }
+    BigInteger lhsScratch;
+    BigInteger rhsScratch;
 
-            break;
-        }
-        case TYPE_PRINT: {
-            if (_values.empty()) {
-                throw std::runtime_error(
-                    "value stack is empty, nothing to print");
-            }
+    return MakeInteger(heap,
+        operation(AsBigInteger(lhs, lhsScratch), AsBigInteger(rhs, rhsScratch)));
+}
 
-            std::cout << _values.back().lock()->Value() << "\n";
-            _values.pop_back();
+// A temporary operand is dead once popped, so a big result can be stored into
+// its node instead of a freshly allocated one.
+bool CanOverwrite(const VmValue& target)
+{
+    return target.GetType() == VALUE_TYPE_BIG_INTEGER
+        && target.Big()->IsTemporary();
+}
 
-            break;
-        }
-        case TYPE_ADD: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for add");
-            }
+template <typename Operation>
+VmValue CalculateInPlace(IntegerNode* target, const VmValue& other,
+    Operation operation)
+{
+    BigInteger scratch;
+    BigInteger& value = target->MutableValue();
+
+    operation(value, AsBigInteger(other, scratch));
+
+    if (value.FitsInt64()) {
+        return VmValue(value.ToInt64());
+    }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    return VmValue(target);
+}
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+int Compare(const VmValue& lhs, const VmValue& rhs)
+{
+    CheckIntegers(lhs, rhs, "comparing integer and non-integer");
 
-            std::shared_ptr<VmNode> result = *lhs.get() + *rhs.get();
+    if (lhs.IsSmall() && rhs.IsSmall()) {
+        return (lhs.Small() > rhs.Small()) - (lhs.Small() < rhs.Small());
+    }
 
-            frame.objects.push_back(result);
-            _values.push_back(frame.objects.back());
+    BigInteger lhsScratch;
+    BigInteger rhsScratch;
 
-            break;
+    return AsBigInteger(lhs, lhsScratch).Compare(AsBigInteger(rhs, rhsScratch));
+}
+
+bool Equals(const VmValue& lhs, const VmValue& rhs, const char* operation)
+{
+    if (!lhs.IsInteger()) {
+        // Works only with 0. That is an equivalent of checking for nulls.
+        if (!rhs.IsSmall() || rhs.Small() != 0) {
+            throw std::runtime_error(std::string("cannot compare ")
+                + (lhs.IsArray() ? "arrays" : "records")
+                + " with value other than 0 (null)");
         }
-        case TYPE_SUB: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for sub");
-            }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+        // Always false, the array or record surely exists since we have its
+        // value.
+        return false;
+    }
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+    if (!rhs.IsInteger()) {
+        throw std::runtime_error(std::string(operation) + " integer and non-integer");
+    }
 
-            std::shared_ptr<VmNode> result = *lhs.get() - *rhs.get();
+    return Compare(lhs, rhs) == 0;
+}
 
-            frame.objects.push_back(result);
-            _values.push_back(frame.objects.back());
+VmValue Negate(Heap& heap, const VmValue& value)
+{
+    CheckInteger(value);
 
-            break;
-        }
-        case TYPE_MUL: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for mul");
-            }
+    if (value.IsSmall() && value.Small() != INT64_MIN) {
+        return VmValue(-value.Small());
+    }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    BigInteger scratch;
+    BigInteger result = AsBigInteger(value, scratch);
+    result.Negate();
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+    return MakeInteger(heap, std::move(result));
+}
 
-            std::shared_ptr<VmNode> result = *lhs.get() * *rhs.get();
+void VirtualMachine::PushFrame(int function, int returnAddress)
+{
+    Frame frame;
+    frame.base = _locals.size();
+    frame.function = function;
+    frame.returnAddress = returnAddress;
+
+    _locals.resize(
+        frame.base + _functions[function].slots, VmValue::Undefined());
+    _frames.push_back(frame);
+}
 
-            frame.objects.push_back(result);
-            _values.push_back(frame.objects.back());
+VmValue& VirtualMachine::GetVariable(const Frame& frame, int slot)
+{
+    VmValue& value = _locals[frame.base + slot];
 
-            break;
-        }
-        case TYPE_DIV: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for div");
-            }
+    if (value.GetType() == VALUE_TYPE_UNDEFINED) {
+        throw std::runtime_error("unknown variable: "
+            + _functions[frame.function].variables[slot]);
+    }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    return value;
+}
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+ArrayNode* VirtualMachine::GetArray(const Frame& frame, int slot)
+{
+    const VmValue& value = GetVariable(frame, slot);
 
-            std::shared_ptr<VmNode> result = *lhs.get() / *rhs.get();
+    if (!value.IsArray()) {
+        throw std::runtime_error(
+            _functions[frame.function].variables[slot] + " is not an array");
+    }
 
-            frame.objects.push_back(result);
-            _values.push_back(frame.objects.back());
+    return value.Array();
+}
 
-            break;
-        }
-        case TYPE_MOD: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for mod");
-            }
+// Field read or written by a getField/setField instruction. The offset in
+// the instruction is the one of the last record it accessed, or the one the
+// compiler knew. Records of another type have the field looked up in their
+// own layout, and the instruction keeps the new offset.
+VmValue& VirtualMachine::GetField(const Frame& frame, Bytecode& code)
+{
+    const auto [slot, offset, fieldName] = code.arguments;
+    const VmValue& value = GetVariable(frame, slot);
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    if (!value.IsRecord()) {
+        throw std::runtime_error(
+            _functions[frame.function].variables[slot] + " is not a record");
+    }
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+    RecordNode* record = value.Record();
 
-            std::shared_ptr<VmNode> result = *lhs.get() % *rhs.get();
+    if (record->HasField(offset, fieldName)) {
+        return record->Field(offset);
+    }
 
-            frame.objects.push_back(result);
-            _values.push_back(frame.objects.back());
+    int found = record->FindField(fieldName);
 
-            break;
-        }
-        case TYPE_NEG: {
-            if (_values.empty()) {
-                throw std::runtime_error("value stack is empty for neg");
-            }
+    if (found < 0) {
+        throw std::runtime_error("record " + record->Layout()->name
+            + " has no field " + _fieldNames[fieldName]);
+    }
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
+    code.arguments[1] = found;
 
-            frame.objects.push_back(lhs->Negate());
-            _values.push_back(frame.objects.back());
+    return record->Field(found);
+}
 
-            break;
-        }
-        case TYPE_COMPEQ: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for compeq");
-            }
+// Operands are stack registers, which always hold a value, or variables
+// that Verify() proved assigned: unproven pushes are not folded into the
+// instructions that use them.
+const VmValue& VirtualMachine::GetOperand(const Frame& frame, int operand)
+{
+    if (operand < 0) {
+        return _constants[-1 - operand];
+    }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    return _locals[frame.base + operand];
+}
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+// Marks a result that is about to be pushed: only the operand stack refers
+// to it.
+VmValue Temporary(VmValue value)
+{
+    if (VmNode* node = value.Node()) {
+        node->SetTemporary(true);
+    }
 
-            int result = static_cast<int>(*lhs.get() == *rhs.get());
+    return value;
+}
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+void VirtualMachine::BuildConstantPool()
+{
+    std::unordered_map<std::string, int> indices;
 
-            break;
+    for (auto& instruction : _instructions) {
+        if (instruction.type != TYPE_PUSH || instruction.arguments.size() != 1
+            || !IsNumber(instruction.arguments[0])) {
+            continue;
         }
-        case TYPE_COMPGE: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for compge");
-            }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+        const std::string& literal = instruction.arguments[0];
+        auto [index, inserted] = indices.try_emplace(literal, _constants.size());
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+        if (inserted) {
+            _constants.push_back(MakeInteger(_heap, Integer(literal)));
+        }
+
+        instruction.constant = index->second;
+    }
+}
 
-            int result = static_cast<int>(*lhs.get() >= *rhs.get());
+void VirtualMachine::ResolveRecords()
+{
+    std::unordered_map<std::string, int> fieldNames;
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+    auto intern = [this, &fieldNames](const std::string& field) {
+        auto [id, inserted] = fieldNames.try_emplace(field, _fieldNames.size());
 
-            break;
+        if (inserted) {
+            _fieldNames.push_back(field);
         }
-        case TYPE_COMPGT: {
-            if (_values.size() < 2) {
+
+        return id->second;
+    };
+
+    for (auto& instruction : _instructions) {
+        const auto& arguments = instruction.arguments;
+
+        if (instruction.type == TYPE_RECORD) {
+            if (arguments.size() < 2) {
                 throw std::runtime_error(
-                    "value stack does not contain 2 variables for compgt");
+                    "record needs a variable and a record name");
             }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+            std::vector<std::string> fields(arguments.begin() + 2, arguments.end());
+            auto [layout, inserted] = _layouts.try_emplace(arguments[1]);
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+            if (inserted) {
+                layout->second.name = arguments[1];
+                layout->second.fields = fields;
 
-            int result = static_cast<int>(*lhs.get() > *rhs.get());
-
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+                for (const auto& field : fields) {
+                    layout->second.fieldNames.push_back(intern(field));
+                }
+            } else if (layout->second.fields != fields) {
+                throw std::runtime_error("record " + arguments[1]
+                    + " is declared with different fields");
+            }
 
-            break;
-        }
-        case TYPE_COMPLE: {
-            if (_values.size() < 2) {
+            instruction.layout = &layout->second;
+        } else if (instruction.type == TYPE_GET_FIELD
+            || instruction.type == TYPE_SET_FIELD) {
+            if (arguments.size() != 3) {
                 throw std::runtime_error(
-                    "value stack does not contain 2 variables for comple");
+                    "field access needs a variable, a field and its offset");
             }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+            instruction.fieldName = intern(arguments[1]);
+            instruction.fieldOffset = stoi(arguments[2]);
+        }
+    }
+}
+
+void CheckArguments(const Instruction& instruction, size_t count)
+{
+    if (instruction.arguments.size() != count) {
+        throw std::runtime_error(instructionTypeToStr[instruction.type]
+            + " should have " + std::to_string(count) + " argument(s)");
+    }
+}
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+int FindMark(const std::unordered_map<std::string, int>& marks,
+    const std::string& mark)
+{
+    auto position = marks.find(mark);
 
-            int result = static_cast<int>(*lhs.get() <= *rhs.get());
+    if (position == marks.end()) {
+        throw std::runtime_error("unknown mark or function: " + mark);
+    }
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+    return position->second;
+}
 
-            break;
+// Fills _functions with the entrypoint and every function it calls, and
+// returns the function each instruction belongs to: the one whose entry
+// reaches it without going through a call.
+std::vector<int> VirtualMachine::FindFunctions()
+{
+    std::unordered_map<std::string, int> indices;
+    std::vector<int> owners(_instructions.size(), -1);
+
+    auto addFunction = [this, &indices](const std::string& name) {
+        if (indices.try_emplace(name, _functions.size()).second) {
+            Function function;
+            function.name = name;
+            _functions.push_back(std::move(function));
         }
-        case TYPE_COMPLT: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for complt");
-            }
+    };
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    addFunction("entrypoint");
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+    // Calls found on the way append to _functions.
+    for (int function = 0; function < _functions.size(); ++function) {
+        std::stack<int> pending;
+        pending.push(FindMark(_marks, _functions[function].name));
 
-            int result = static_cast<int>(*lhs.get() < *rhs.get());
+        while (!pending.empty()) {
+            int index = pending.top();
+            pending.pop();
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+            // Running past the last instruction ends the program.
+            if (index == _instructions.size() || owners[index] == function) {
+                continue;
+            }
 
-            break;
-        }
-        case TYPE_COMPNE: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for compne");
+            if (owners[index] != -1) {
+                throw std::runtime_error("functions "
+                    + _functions[owners[index]].name + " and "
+                    + _functions[function].name + " share code");
             }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+            owners[index] = function;
+            const auto& instruction = _instructions[index];
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+            if (instruction.type == TYPE_RETURN) {
+                continue;
+            }
 
-            int result = static_cast<int>(*lhs.get() != *rhs.get());
+            if (instruction.type == TYPE_JMP) {
+                CheckArguments(instruction, 1);
+                pending.push(FindMark(_marks, instruction.arguments[0]));
+                continue;
+            }
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+            pending.push(index + 1);
 
-            break;
-        }
-        case TYPE_BIN_AND: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for compne");
+            if (instruction.type == TYPE_JZ) {
+                CheckArguments(instruction, 1);
+                pending.push(FindMark(_marks, instruction.arguments[0]));
             }
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+            if (instruction.type == TYPE_CALL) {
+                CheckArguments(instruction, 1);
+                addFunction(instruction.arguments[0]);
+            }
+        }
+    }
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+    return owners;
+}
 
-            int result = static_cast<int>((lhs.get()->Value() != "0") && (rhs.get()->Value() != "0"));
+void VirtualMachine::Lower()
+{
+    std::vector<int> owners = FindFunctions();
+    std::vector<std::unordered_map<std::string, int>> slots(_functions.size());
+    std::unordered_map<std::string, int> functions;
+    std::unordered_map<const RecordLayout*, int> layouts;
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+    for (int function = 0; function < _functions.size(); ++function) {
+        functions[_functions[function].name] = function;
+    }
 
-            break;
-        }
-        case TYPE_BIN_OR: {
-            if (_values.size() < 2) {
-                throw std::runtime_error(
-                    "value stack does not contain 2 variables for compne");
-            }
+    // Values each function returns, which a discard of its results drops.
+    // Returns with fewer values are padded to this count.
+    std::vector<int> returnCounts(_functions.size(), 0);
 
-            std::shared_ptr<VmNode> rhs = _values.back().lock();
-            _values.pop_back();
+    for (int index = 0; index < _instructions.size(); ++index) {
+        const auto& instruction = _instructions[index];
 
-            std::shared_ptr<VmNode> lhs = _values.back().lock();
-            _values.pop_back();
+        if (instruction.type == TYPE_RETURN && owners[index] != -1) {
+            CheckArguments(instruction, 1);
 
-            int result = static_cast<int>((lhs.get()->Value() != "0") || (rhs.get()->Value() != "0"));
+            int& count = returnCounts[owners[index]];
+            count = std::max(count, stoi(instruction.arguments[0]));
+        }
+    }
 
-            frame.objects.push_back(std::make_shared<IntegerNode>(result));
-            _values.push_back(frame.objects.back());
+    _code.reserve(_instructions.size());
 
-            break;
+    for (int index = 0; index < _instructions.size(); ++index) {
+        const auto& instruction = _instructions[index];
+        const auto& arguments = instruction.arguments;
+        Bytecode code { instruction.type };
+
+        // Unreachable, so it is never executed.
+        if (owners[index] == -1) {
+            _code.push_back(code);
+            continue;
         }
-        case TYPE_JMP: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error(
-                    "jmp should have exactly one argument");
-            }
 
-            // Substitute 1, because of ++currentInstruction at the end of
-            // the cycle.
-            currentInstruction = _marks[instruction.arguments[0]] - 1;
+        Function& owner = _functions[owners[index]];
 
-            break;
-        }
-        case TYPE_JZ: {
-            if (_values.empty()) {
-                throw std::runtime_error("value stack is empty for jz");
-            }
+        auto variable = [&owner, &slots, &owners, index](const std::string& name) {
+            auto [slot, inserted] =
+                slots[owners[index]].try_emplace(name, owner.variables.size());
 
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error(
-                    "jz should have exactly one argument");
+            if (inserted) {
+                owner.variables.push_back(name);
             }
 
-            if (_values.back().lock()->GetNodeType() != NODE_TYPE_INTEGER) {
-                throw std::runtime_error(
-                    "jz cannot check because top of the stack is not "
-                    "integer");
-            }
+            return slot->second;
+        };
 
-            // jz jumps if the top of the stack is 0
-            if (std::static_pointer_cast<IntegerNode>(_values.back().lock())
-                    ->RealValue()
-                    .Value()
-                == "0") {
-                // Substitute 1, because of ++currentInstruction at the end
-                // of the cycle.
-                currentInstruction = _marks[instruction.arguments[0]] - 1;
-            }
+        switch (instruction.type) {
+        case TYPE_PUSH:
+            CheckArguments(instruction, 1);
 
-            _values.pop_back();
+            if (instruction.constant >= 0) {
+                code.type = TYPE_PUSH_CONSTANT;
+                code.arguments[0] = instruction.constant;
+            } else {
+                code.arguments[0] = variable(arguments[0]);
+            }
 
             break;
-        }
-        case TYPE_CALL: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error("call should have one argument");
+        case TYPE_POP:
+            if (arguments.size() == 2 && arguments[0] == "arr") {
+                code.type = TYPE_POP_ELEMENT;
+                code.arguments[0] = variable(arguments[1]);
+            } else {
+                CheckArguments(instruction, 1);
+                code.arguments[0] = variable(arguments[0]);
             }
 
-            int jumpTo = _marks[instruction.arguments[0]];
-            int returnTo = currentInstruction + 1;
+            break;
+        case TYPE_JMP:
+        case TYPE_JZ:
+            CheckArguments(instruction, 1);
+            code.arguments[0] = FindMark(_marks, arguments[0]);
 
-            _frames.push_back(std::move(Frame()));
-            _frames.back().returnAddress = returnTo;
+            break;
+        case TYPE_CALL:
+            CheckArguments(instruction, 1);
+            code.arguments[0] = FindMark(_marks, arguments[0]);
+            code.arguments[1] = functions[arguments[0]];
 
-            // Substitute 1, because of ++currentInstruction at the end
-            // of the cycle.
-            currentInstruction = jumpTo - 1;
+            break;
+        case TYPE_RETURN:
+            CheckArguments(instruction, 1);
+            code.arguments[0] = stoi(arguments[0]);
+            code.arguments[1] = returnCounts[owners[index]];
 
             break;
-        }
-        case TYPE_RETURN: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error("return should have one argument");
-            }
+        case TYPE_DISCARD: {
+            // Either a count or the function whose results are dropped.
+            CheckArguments(instruction, 1);
 
-            // If returnAddress is -1, then we are returning from the
-            // entrypoint. Therefore, end the program.
-            if (frame.returnAddress == -1) {
-                return;
-            }
+            if (IsNumber(arguments[0])) {
+                code.arguments[0] = stoi(arguments[0]);
+            } else {
+                auto function = functions.find(arguments[0]);
 
-            int amountOfReturned = stoi(instruction.arguments[0]);
+                if (function == functions.end()) {
+                    throw std::runtime_error(
+                        "discard of unknown function " + arguments[0]);
+                }
 
-            if (_values.size() < amountOfReturned) {
-                throw std::runtime_error(
-                    "amount of returned values is greater than the stack "
-                    "size");
+                code.arguments[0] = returnCounts[function->second];
             }
 
-            // Objects that were returned should not be deallocated.
-            // Therefore, we push them at the previous frame.
-            auto& previousFrame = _frames[_frames.size() - 2];
-
-            for (int i = 0; i < amountOfReturned; ++i) {
-                std::shared_ptr<VmNode> locked = _values[_values.size() - 1 - i].lock();
+            break;
+        }
+        case TYPE_ARRAY:
+        case TYPE_ACCESS:
+        case TYPE_LENGTH:
+        case TYPE_SLICE:
+            CheckArguments(instruction, 1);
+            code.arguments[0] = variable(arguments[0]);
 
-                previousFrame.objects.push_back(locked);
+            break;
+        case TYPE_RECORD: {
+            auto [index, inserted] =
+                layouts.try_emplace(instruction.layout, _recordLayouts.size());
 
-                // If this node is an array, we should rescue all objects
-                // inside array.
-                RescueArray(previousFrame, locked);
+            if (inserted) {
+                _recordLayouts.push_back(instruction.layout);
             }
 
-            // Substitute 1, because of ++currentInstruction at the end
-            // of the cycle.
-            currentInstruction = frame.returnAddress - 1;
-            _frames.pop_back();
+            code.arguments[0] = variable(arguments[0]);
+            code.arguments[1] = index->second;
 
             break;
         }
-        case TYPE_ARRAY: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error("array needs 1 argument");
-            }
+        case TYPE_GET_FIELD:
+        case TYPE_SET_FIELD:
+            code.arguments[0] = variable(arguments[0]);
+            code.arguments[1] = instruction.fieldOffset;
+            code.arguments[2] = instruction.fieldName;
 
-            if (_values.empty()) {
-                throw std::runtime_error(
-                    "value stack is empty, no size for creating array");
-            }
+            break;
+        default:
+            break;
+        }
 
-            const std::string& arg = instruction.arguments[0];
-            std::shared_ptr<VmNode> arraySizeNode = _values.back().lock();
+        _code.push_back(code);
+    }
 
-            _values.pop_back();
+    // Running past the last instruction ends the program, so execution
+    // never has to check the bounds.
+    _code.push_back({ TYPE_END });
 
-            if (arraySizeNode->GetNodeType() != NODE_TYPE_INTEGER) {
-                throw std::runtime_error(
-                    "provided array size is not integer");
-            }
+    for (Function& function : _functions) {
+        function.slots = function.variables.size();
+    }
 
-            BigInteger arraySize = std::static_pointer_cast<IntegerNode>(arraySizeNode)
-                                       ->RealValue();
+    _owners = std::move(owners);
+}
 
-            if (arraySize > BigInteger(ARRAY_SIZE_LIMIT)) {
-                throw std::runtime_error("provided array size is too big");
-            }
+// Values popped and pushed by an instruction. Calls and returns depend on the
+// function, Verify() handles them itself.
+std::pair<int, int> StackEffect(const Bytecode& code)
+{
+    switch (code.type) {
+    case TYPE_PUSH:
+    case TYPE_PUSH_CONSTANT:
+    case TYPE_PUSH_CHECKED:
+    case TYPE_LENGTH:
+    case TYPE_GET_FIELD:
+        return { 0, 1 };
+    case TYPE_POP:
+    case TYPE_PRINT:
+    case TYPE_JZ:
+    case TYPE_JZ_CHECKED:
+    case TYPE_ARRAY:
+    case TYPE_SET_FIELD:
+        return { 1, 0 };
+    case TYPE_POP_ELEMENT:
+        return { 2, 0 };
+    case TYPE_DISCARD:
+        return { code.arguments[0], 0 };
+    case TYPE_NEG:
+    case TYPE_ACCESS:
+        return { 1, 1 };
+    case TYPE_ADD:
+    case TYPE_SUB:
+    case TYPE_MUL:
+    case TYPE_DIV:
+    case TYPE_MOD:
+    case TYPE_COMPLT:
+    case TYPE_COMPGT:
+    case TYPE_COMPGE:
+    case TYPE_COMPLE:
+    case TYPE_COMPNE:
+    case TYPE_COMPEQ:
+    case TYPE_BIN_AND:
+    case TYPE_BIN_OR:
+    case TYPE_SLICE:
+        return { 2, 1 };
+    default:
+        return { 0, 0 };
+    }
+}
 
-            int integerSize = stoi(arraySize.Value());
+// Operand stack use of a function, as depths relative to the one at its
+// entry. Parameters are popped from the caller's part, so lowest is
+// negative for functions that have them.
+struct StackUse {
+    // Whether any return is reachable, and the depth every one leaves,
+    // returned values included.
+    bool returns = false;
+    int returned = 0;
 
-            frame.objects.push_back(
-                std::make_shared<ArrayNode>(integerSize, frame));
+    int lowest = 0;
+    int highest = 0;
 
-            frame.variables[arg] = frame.objects.back();
+    bool operator==(const StackUse& other) const = default;
+};
+
+constexpr int UNREACHED_DEPTH = std::numeric_limits<int>::min();
+
+// Abstract interpretation of one function over its control flow graph:
+// every instruction gets the stack depth it runs at in depths, which has to
+// be the same on every path to it. Calls use what is known about the callee
+// so far; the code after a call to a function that is not known to return is
+// not looked at yet. Functions do not share code, so one depths vector holds
+// all of them.
+StackUse AnalyzeStack(const std::vector<Bytecode>& code, int entry,
+    const std::vector<StackUse>& uses, const std::string& name,
+    std::vector<int>& depths)
+{
+    StackUse use;
+    std::stack<int> pending;
+
+    auto reach = [&](int index, int depth) {
+        if (depths[index] == UNREACHED_DEPTH) {
+            depths[index] = depth;
+            use.highest = std::max(use.highest, depth);
+            pending.push(index);
+        } else if (depths[index] != depth) {
+            throw std::runtime_error("operand stack depth differs between "
+                "paths to instruction " + std::to_string(index)
+                + " in function " + name);
+        }
+    };
+
+    reach(entry, 0);
+
+    while (!pending.empty()) {
+        int index = pending.top();
+        pending.pop();
+
+        const Bytecode& instruction = code[index];
+        int depth = depths[index];
+
+        if (instruction.type == TYPE_END) {
+            continue;
+        }
+
+        if (instruction.type == TYPE_RETURN) {
+            // Zeros make up for the values this return does not give back.
+            int count = instruction.arguments[0];
+            int returned = depth - count + instruction.arguments[1];
+
+            use.lowest = std::min(use.lowest, depth - count);
+            use.highest = std::max(use.highest, returned);
+
+            if (use.returns && use.returned != returned) {
+                throw std::runtime_error("function " + name
+                    + " leaves a different number of values on the operand "
+                      "stack depending on where it returns");
+            }
+
+            use.returns = true;
+            use.returned = returned;
+            continue;
+        }
+
+        if (instruction.type == TYPE_CALL) {
+            const StackUse& callee = uses[instruction.arguments[1]];
+            use.lowest = std::min(use.lowest, depth + callee.lowest);
+
+            if (callee.returns) {
+                reach(index + 1, depth + callee.returned);
+            }
+
+            continue;
+        }
+
+        auto [popped, pushed] = StackEffect(instruction);
+        int next = depth - popped + pushed;
+
+        use.lowest = std::min(use.lowest, depth - popped);
+
+        if (instruction.type == TYPE_JMP) {
+            reach(instruction.arguments[0], next);
+            continue;
+        }
+
+        reach(index + 1, next);
+
+        if (instruction.type == TYPE_JZ) {
+            reach(instruction.arguments[0], next);
+        }
+    }
+
+    return use;
+}
+
+void VirtualMachine::Verify()
+{
+    // Jump and call targets, argument counts and variable slots are already
+    // checked by Lower(), what is left is the operand stack. What a function
+    // does to it depends on its callees, recursive ones included, so the
+    // analysis is repeated until nothing changes.
+    std::vector<StackUse> uses(_functions.size());
+    std::vector<int> depths;
+    size_t rounds = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        depths.assign(_code.size(), UNREACHED_DEPTH);
+
+        for (int function = 0; function < _functions.size(); ++function) {
+            const std::string& name = _functions[function].name;
+            StackUse use = AnalyzeStack(
+                _code, FindMark(_marks, name), uses, name, depths);
+
+            if (use != uses[function]) {
+                uses[function] = use;
+                changed = true;
+            }
+        }
+
+        // Every round settles at least one more function, unless a
+        // recursive one keeps reaching deeper into the caller's values.
+        if (changed && ++rounds > _functions.size() + 1) {
+            throw std::runtime_error("operand stack use of recursive calls "
+                "has no bound");
+        }
+    }
+
+    if (uses[0].lowest < 0) {
+        throw std::runtime_error(
+            "entrypoint pops more values than the operand stack has");
+    }
+
+    for (int function = 0; function < _functions.size(); ++function) {
+        _functions[function].maxStack = uses[function].highest;
+        _functions[function].lowest = uses[function].lowest;
+        _functions[function].returned = uses[function].returned;
+    }
+
+    // The last round saw the final uses, so its depths are the right ones.
+    _depths = std::move(depths);
+
+    for (Bytecode& code : _code) {
+        if (code.type == TYPE_CALL) {
+            code.arguments[2] = _functions[code.arguments[1]].maxStack;
+        }
+    }
+
+    SelectChecks();
+}
+
+// Whether an instruction always leaves an integer on top of the operand
+// stack.
+bool PushesInteger(VmInstructionType type)
+{
+    switch (type) {
+    case TYPE_PUSH_CONSTANT:
+    case TYPE_ADD:
+    case TYPE_SUB:
+    case TYPE_MUL:
+    case TYPE_DIV:
+    case TYPE_MOD:
+    case TYPE_COMPLT:
+    case TYPE_COMPGT:
+    case TYPE_COMPGE:
+    case TYPE_COMPLE:
+    case TYPE_COMPNE:
+    case TYPE_COMPEQ:
+    case TYPE_NEG:
+    case TYPE_BIN_AND:
+    case TYPE_BIN_OR:
+    case TYPE_LENGTH:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Pushes of a variable and jz keep their checks only where the code does not
+// make them unnecessary. A variable has to be assigned on every path to the
+// push, which is found by abstract interpretation like AnalyzeStack(): each
+// instruction gets the variables assigned on all paths to it, and where paths
+// meet only the ones assigned on each of them are kept, so the sets only
+// shrink and the analysis ends. A jz has an integer condition if the only way
+// to it is from an instruction that computes one. The others become the
+// checked variants.
+void VirtualMachine::SelectChecks()
+{
+    std::vector<std::vector<bool>> assigned(_code.size());
+    std::vector<bool> reached(_code.size(), false);
+    std::vector<bool> targets(_code.size(), false);
+
+    for (int function = 0; function < _functions.size(); ++function) {
+        int entry = FindMark(_marks, _functions[function].name);
+        std::stack<int> pending;
+
+        auto reach = [&](int index, const std::vector<bool>& state) {
+            // Code after a call to a function that never returns.
+            if (_depths[index] == UNREACHED_DEPTH) {
+                return;
+            }
+
+            if (!reached[index]) {
+                reached[index] = true;
+                assigned[index] = state;
+                pending.push(index);
+                return;
+            }
+
+            std::vector<bool>& known = assigned[index];
+            bool changed = false;
+
+            for (size_t slot = 0; slot < known.size(); ++slot) {
+                if (known[slot] && !state[slot]) {
+                    known[slot] = false;
+                    changed = true;
+                }
+            }
+
+            if (changed) {
+                pending.push(index);
+            }
+        };
+
+        targets[entry] = true;
+        reach(entry,
+            std::vector<bool>(_functions[function].variables.size(), false));
+
+        while (!pending.empty()) {
+            int index = pending.top();
+            pending.pop();
+
+            const Bytecode& instruction = _code[index];
+            std::vector<bool> state = assigned[index];
+
+            if (instruction.type == TYPE_END
+                || instruction.type == TYPE_RETURN) {
+                continue;
+            }
+
+            if (instruction.type == TYPE_POP || instruction.type == TYPE_ARRAY
+                || instruction.type == TYPE_RECORD) {
+                state[instruction.arguments[0]] = true;
+            }
+
+            if (instruction.type == TYPE_JMP || instruction.type == TYPE_JZ) {
+                targets[instruction.arguments[0]] = true;
+                reach(instruction.arguments[0], state);
+            }
+
+            if (instruction.type != TYPE_JMP) {
+                reach(index + 1, state);
+            }
+        }
+    }
+
+    for (int index = 0; index < _code.size(); ++index) {
+        Bytecode& instruction = _code[index];
+
+        if (!reached[index]) {
+            continue;
+        }
+
+        if (instruction.type == TYPE_PUSH
+            && !assigned[index][instruction.arguments[0]]) {
+            instruction.type = TYPE_PUSH_CHECKED;
+        }
+
+        if (instruction.type == TYPE_JZ
+            && (targets[index] || !PushesInteger(_code[index - 1].type))) {
+            instruction.type = TYPE_JZ_CHECKED;
+        }
+    }
+}
+
+// Arguments of a register instruction that are operands it reads.
+std::vector<int> OperandArguments(RegisterInstructionType type)
+{
+    switch (type) {
+    case REGISTER_MOVE:
+    case REGISTER_NEG:
+    case REGISTER_ARRAY:
+        return { 1 };
+    case REGISTER_ADD:
+    case REGISTER_SUB:
+    case REGISTER_MUL:
+    case REGISTER_DIV:
+    case REGISTER_MOD:
+    case REGISTER_COMPLT:
+    case REGISTER_COMPGT:
+    case REGISTER_COMPGE:
+    case REGISTER_COMPLE:
+    case REGISTER_COMPNE:
+    case REGISTER_COMPEQ:
+    case REGISTER_BIN_AND:
+    case REGISTER_BIN_OR:
+    case REGISTER_SET_ELEMENT:
+        return { 1, 2 };
+    case REGISTER_PRINT:
+    case REGISTER_JZ:
+    case REGISTER_JZ_CHECKED:
+    case REGISTER_SET_FIELD:
+        return { 0 };
+    case REGISTER_ACCESS:
+        return { 2 };
+    default:
+        return {};
+    }
+}
+
+// Whether the first argument of a register instruction is the register it
+// writes its result to.
+bool WritesResult(RegisterInstructionType type)
+{
+    switch (type) {
+    case REGISTER_ADD:
+    case REGISTER_SUB:
+    case REGISTER_MUL:
+    case REGISTER_DIV:
+    case REGISTER_MOD:
+    case REGISTER_COMPLT:
+    case REGISTER_COMPGT:
+    case REGISTER_COMPGE:
+    case REGISTER_COMPLE:
+    case REGISTER_COMPNE:
+    case REGISTER_COMPEQ:
+    case REGISTER_BIN_AND:
+    case REGISTER_BIN_OR:
+    case REGISTER_NEG:
+    case REGISTER_ACCESS:
+    case REGISTER_LENGTH:
+    case REGISTER_SLICE:
+    case REGISTER_GET_FIELD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsComparison(RegisterInstructionType type)
+{
+    return type >= REGISTER_COMPLT && type <= REGISTER_COMPEQ;
+}
+
+std::unordered_map<VmInstructionType, RegisterInstructionType>
+    binaryToRegister = {
+        { TYPE_ADD, REGISTER_ADD },
+        { TYPE_SUB, REGISTER_SUB },
+        { TYPE_MUL, REGISTER_MUL },
+        { TYPE_DIV, REGISTER_DIV },
+        { TYPE_MOD, REGISTER_MOD },
+        { TYPE_COMPLT, REGISTER_COMPLT },
+        { TYPE_COMPGT, REGISTER_COMPGT },
+        { TYPE_COMPGE, REGISTER_COMPGE },
+        { TYPE_COMPLE, REGISTER_COMPLE },
+        { TYPE_COMPNE, REGISTER_COMPNE },
+        { TYPE_COMPEQ, REGISTER_COMPEQ },
+        { TYPE_BIN_AND, REGISTER_BIN_AND },
+        { TYPE_BIN_OR, REGISTER_BIN_OR },
+    };
+
+// The verified stack depths tell which operand stack position every
+// instruction works on, so each bytecode first becomes one register
+// instruction that names those positions as registers. Then the values that
+// only pass through the stack are taken out: pushes of a variable or a
+// constant right before the instruction that pops them become its operands,
+// results popped into a variable right away are written there, and
+// comparisons that only feed a jz become a conditional jump. No jump may land
+// between the instructions that are merged.
+void VirtualMachine::LowerToRegisters()
+{
+    for (Function& function : _functions) {
+        function.slots = function.variables.size() + function.maxStack
+            + static_cast<size_t>(-function.lowest);
+    }
+
+    // Register of an operand stack position of the function that owns the
+    // instruction.
+    auto stackRegister = [this](int index, int position) {
+        const Function& function = _functions[_owners[index]];
+
+        return static_cast<int>(function.variables.size()) + position
+            - function.lowest;
+    };
+
+    auto isVariable = [this](int index, int operand) {
+        return operand >= 0
+            && operand < _functions[_owners[index]].variables.size();
+    };
+
+    std::vector<RegisterCode> code(_code.size());
+    std::vector<bool> removed(_code.size(), false);
+    std::vector<bool> targets(_code.size(), false);
+
+    for (const Function& function : _functions) {
+        targets[FindMark(_marks, function.name)] = true;
+    }
+
+    for (int index = 0; index < _code.size(); ++index) {
+        const Bytecode& instruction = _code[index];
+        const auto [first, second, third] = instruction.arguments;
+        int depth = _depths[index];
+        RegisterCode& lowered = code[index];
+
+        if (instruction.type == TYPE_JMP || instruction.type == TYPE_JZ
+            || instruction.type == TYPE_JZ_CHECKED) {
+            targets[first] = true;
+        }
+
+        if (instruction.type == TYPE_END) {
+            lowered.type = REGISTER_END;
+            continue;
+        }
+
+        if (depth == UNREACHED_DEPTH) {
+            removed[index] = true;
+            continue;
+        }
+
+        // Register of the value offset positions below the top of the
+        // stack, 0 is the first free one.
+        auto top = [&stackRegister, index, depth](int offset) {
+            return stackRegister(index, depth - offset);
+        };
+
+        switch (instruction.type) {
+        case TYPE_PUSH:
+            lowered = { REGISTER_MOVE, { top(0), first } };
+            break;
+        case TYPE_PUSH_CONSTANT:
+            lowered = { REGISTER_MOVE, { top(0), -1 - first } };
+            break;
+        case TYPE_PUSH_CHECKED:
+            lowered = { REGISTER_MOVE_CHECKED, { top(0), first } };
+            break;
+        case TYPE_POP:
+            lowered = { REGISTER_MOVE, { first, top(1) } };
+            break;
+        case TYPE_POP_ELEMENT:
+            lowered = { REGISTER_SET_ELEMENT, { first, top(1), top(2) } };
+            break;
+        case TYPE_PRINT:
+            lowered = { REGISTER_PRINT, { top(1) } };
+            break;
+        case TYPE_NEG:
+            lowered = { REGISTER_NEG, { top(1), top(1) } };
+            break;
+        case TYPE_JMP:
+            lowered = { REGISTER_JMP, { first } };
+            break;
+        case TYPE_JZ:
+            lowered = { REGISTER_JZ, { top(1), first } };
+            break;
+        case TYPE_JZ_CHECKED:
+            lowered = { REGISTER_JZ_CHECKED, { top(1), first } };
+            break;
+        case TYPE_CALL:
+            lowered = { REGISTER_CALL,
+                { first, second,
+                    stackRegister(index, depth + _functions[second].lowest) } };
+            break;
+        case TYPE_RETURN:
+            lowered = { REGISTER_RETURN, { first, second - first } };
+            break;
+        case TYPE_DISCARD:
+            if (first == 0) {
+                removed[index] = true;
+            } else {
+                lowered = { REGISTER_CLEAR, { top(first), first } };
+            }
+
+            break;
+        case TYPE_ARRAY:
+            lowered = { REGISTER_ARRAY, { first, top(1) } };
+            break;
+        case TYPE_ACCESS:
+            lowered = { REGISTER_ACCESS, { top(1), first, top(1) } };
+            break;
+        case TYPE_LENGTH:
+            lowered = { REGISTER_LENGTH, { top(0), first } };
+            break;
+        case TYPE_SLICE:
+            lowered = { REGISTER_SLICE, { top(2), first, top(2) } };
+            break;
+        case TYPE_RECORD:
+            lowered = { REGISTER_RECORD, { first, second } };
+            break;
+        case TYPE_GET_FIELD:
+            lowered = { REGISTER_GET_FIELD, { top(0), index } };
+            break;
+        case TYPE_SET_FIELD:
+            lowered = { REGISTER_SET_FIELD, { top(1), index } };
+            break;
+        default:
+            lowered = { binaryToRegister.at(instruction.type),
+                { top(2), top(2), top(1) } };
+            break;
+        }
+    }
+
+    // A push is a move into a stack register. Walking back from the
+    // instruction that pops, each push has to fill one of its operands.
+    for (int index = 0; index < code.size(); ++index) {
+        if (removed[index]) {
+            continue;
+        }
+
+        std::vector<int> operands = OperandArguments(code[index].type);
+
+        for (int push = index - 1; push >= 0 && !removed[push]
+             && !targets[push + 1] && code[push].type == REGISTER_MOVE
+             && !isVariable(push, code[push].arguments[0]);
+             --push) {
+            auto operand = std::find_if(operands.begin(), operands.end(),
+                [&](int argument) {
+                    return code[index].arguments[argument]
+                        == code[push].arguments[0];
+                });
+
+            if (operand == operands.end()) {
+                break;
+            }
+
+            code[index].arguments[*operand] = code[push].arguments[1];
+            removed[push] = true;
+        }
+    }
+
+    for (int index = 0; index + 1 < code.size(); ++index) {
+        RegisterCode& producer = code[index];
+        RegisterCode& consumer = code[index + 1];
+
+        if (removed[index] || removed[index + 1] || targets[index + 1]
+            || !WritesResult(producer.type)) {
+            continue;
+        }
+
+        int result = producer.arguments[0];
+
+        if (consumer.type == REGISTER_MOVE && consumer.arguments[1] == result) {
+            producer.arguments[0] = consumer.arguments[0];
+            removed[index + 1] = true;
+        } else if (consumer.type == REGISTER_JZ
+            && consumer.arguments[0] == result && IsComparison(producer.type)) {
+            consumer = { static_cast<RegisterInstructionType>(
+                             REGISTER_JZ_COMPLT + producer.type - REGISTER_COMPLT),
+                { producer.arguments[1], producer.arguments[2],
+                    consumer.arguments[1] } };
+            removed[index] = true;
+        }
+    }
+
+    // A jump to a removed instruction lands on the one it was merged into.
+    std::vector<int> positions(code.size());
+
+    for (int index = 0; index < code.size(); ++index) {
+        positions[index] = _registerCode.size();
+
+        if (!removed[index]) {
+            _registerCode.push_back(code[index]);
+        }
+    }
+
+    for (RegisterCode& instruction : _registerCode) {
+        auto& arguments = instruction.arguments;
+
+        switch (instruction.type) {
+        case REGISTER_JMP:
+        case REGISTER_CALL:
+            arguments[0] = positions[arguments[0]];
+            break;
+        case REGISTER_JZ:
+        case REGISTER_JZ_CHECKED:
+            arguments[1] = positions[arguments[1]];
+            break;
+        case REGISTER_JZ_COMPLT:
+        case REGISTER_JZ_COMPGT:
+        case REGISTER_JZ_COMPGE:
+        case REGISTER_JZ_COMPLE:
+        case REGISTER_JZ_COMPNE:
+        case REGISTER_JZ_COMPEQ:
+            arguments[2] = positions[arguments[2]];
+            break;
+        default:
+            break;
+        }
+    }
+
+    _registerEntry = positions[FindMark(_marks, "entrypoint")];
+}
+
+// Frees a popped operand that is a temporary. Loops produce one per
+// iteration, so this keeps them from piling up between collections.
+void VirtualMachine::Discard(const VmValue& value)
+{
+    if (CanOverwrite(value)) {
+        _heap.Free(value.Big());
+    }
+}
+
+// Same for both operands of an instruction that has just pushed its result,
+// except the one that was overwritten with it.
+void VirtualMachine::DiscardOperands(
+    const VmValue& pushed, const VmValue& lhs, const VmValue& rhs)
+{
+    VmNode* result = pushed.Node();
+
+    if (lhs.Node() != result) {
+        Discard(lhs);
+    }
+
+    if (rhs.Node() != result) {
+        Discard(rhs);
+    }
+}
+
+VmValue* VirtualMachine::ReserveStack(VmValue* top, size_t size)
+{
+    size_t used = top - _values.data();
+
+    if (_values.size() - used < size) {
+        _values.resize(std::max(2 * _values.size(), used + size));
+    }
+
+    return _values.data() + used;
+}
+
+void VirtualMachine::CollectGarbage(VmValue* top)
+{
+    _heap.Collect([this, top](auto visit) {
+        for (VmValue* value = _values.data(); value != top; ++value) {
+            visit(*value);
+        }
+
+        for (VmValue& value : _locals) {
+            visit(value);
+        }
+
+        for (VmValue& value : _constants) {
+            visit(value);
+        }
+    });
+}
+
+// Execute() dispatches with computed goto where the compiler supports it:
+// every handler ends with its own jump to the next one, which the branch
+// predictor tells apart. Define EWLANG_SWITCH_DISPATCH to build the portable
+// switch instead.
+#if defined(__GNUC__) && !defined(EWLANG_SWITCH_DISPATCH)
+#define EWLANG_THREADED_DISPATCH
+#endif
+
+// Between instructions every live value is on the operand stack or in a
+// variable, so this is the only place where it is safe to collect. Jumps
+// overwrite the already advanced instruction pointer.
+#define FETCH()                             \
+    do {                                    \
+        if (_heap.ShouldCollect()) {        \
+            CollectGarbage(sp);             \
+        }                                   \
+                                            \
+        code = &_code[currentInstruction++]; \
+    } while (false)
+
+void VirtualMachine::Execute()
+{
+    size_t currentInstruction = _marks["entrypoint"];
+    Bytecode* code = nullptr;
+
+    PushFrame(0, -1);
+
+    // Only calls and returns change the frame and move the slots. The stack
+    // is verified, so handlers use it without checks. A call makes sure it
+    // has room for everything the callee pushes.
+    Frame* frame = &_frames.back();
+    VmValue* locals = _locals.data() + frame->base;
+    VmValue* sp = ReserveStack(_values.data(), _functions[0].maxStack);
+
+#ifdef EWLANG_THREADED_DISPATCH
+    // In the order of VmInstructionType.
+    static const void* const handlers[] = {
+        &&HANDLER_TYPE_PUSH,
+        &&HANDLER_TYPE_POP,
+        &&HANDLER_TYPE_PRINT,
+        &&HANDLER_TYPE_ADD,
+        &&HANDLER_TYPE_SUB,
+        &&HANDLER_TYPE_MUL,
+        &&HANDLER_TYPE_DIV,
+        &&HANDLER_TYPE_MOD,
+        &&HANDLER_TYPE_COMPLT,
+        &&HANDLER_TYPE_COMPGT,
+        &&HANDLER_TYPE_COMPGE,
+        &&HANDLER_TYPE_COMPLE,
+        &&HANDLER_TYPE_COMPNE,
+        &&HANDLER_TYPE_COMPEQ,
+        &&HANDLER_TYPE_JZ,
+        &&HANDLER_TYPE_JMP,
+        &&HANDLER_TYPE_NEG,
+        &&HANDLER_TYPE_CALL,
+        &&HANDLER_TYPE_RETURN,
+        &&HANDLER_TYPE_ARRAY,
+        &&HANDLER_TYPE_ACCESS,
+        &&HANDLER_TYPE_LENGTH,
+        &&HANDLER_TYPE_BIN_AND,
+        &&HANDLER_TYPE_BIN_OR,
+        &&HANDLER_TYPE_RECORD,
+        &&HANDLER_TYPE_GET_FIELD,
+        &&HANDLER_TYPE_SET_FIELD,
+        &&HANDLER_TYPE_SLICE,
+        &&HANDLER_TYPE_DISCARD,
+        &&HANDLER_TYPE_PUSH_CONSTANT,
+        &&HANDLER_TYPE_POP_ELEMENT,
+        &&HANDLER_TYPE_PUSH_CHECKED,
+        &&HANDLER_TYPE_JZ_CHECKED,
+        &&HANDLER_TYPE_END,
+    };
+
+    static_assert(std::size(handlers) == TYPE_END + 1);
+
+#define HANDLER(type) HANDLER_##type
+#define NEXT()                              \
+    do {                                    \
+        FETCH();                            \
+        goto* handlers[code->type];         \
+    } while (false)
+
+    NEXT();
+#else
+#define HANDLER(type) case type
+#define NEXT() break
+
+    while (true) {
+        FETCH();
+
+        switch (code->type) {
+#endif
+        HANDLER(TYPE_PUSH_CONSTANT): {
+            *sp++ = _constants[code->arguments[0]];
+
+            NEXT();
+        }
+        HANDLER(TYPE_PUSH): {
+            *sp++ = locals[code->arguments[0]];
+
+            NEXT();
+        }
+        HANDLER(TYPE_PUSH_CHECKED): {
+            *sp++ = GetVariable(*frame, code->arguments[0]);
+
+            NEXT();
+        }
+        HANDLER(TYPE_POP): {
+            VmValue value = *--sp;
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
+            }
+
+            locals[code->arguments[0]] = value;
+
+            NEXT();
+        }
+        HANDLER(TYPE_POP_ELEMENT): {
+            VmValue index = *--sp;
+
+            VmValue value = *--sp;
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
+            }
+
+            ArrayNode* array = GetArray(*frame, code->arguments[0]);
+            size_t position = array->ConvertIndexToSizeT(index);
+
+            if (size_t backed = array->Set(position, value)) {
+                _heap.AddBytes(backed);
+            }
+
+            if (!value.IsSmall()) {
+                _heap.RecordWrite(array->Cell(position));
+            }
+
+            Discard(index);
+
+            NEXT();
+        }
+        HANDLER(TYPE_PRINT): {
+            sp[-1].Print(std::cout);
+            std::cout << "\n";
+            Discard(sp[-1]);
+            --sp;
+
+            NEXT();
+        }
+        HANDLER(TYPE_DISCARD): {
+            for (int i = 0; i < code->arguments[0]; ++i) {
+                Discard(*--sp);
+            }
+
+            NEXT();
+        }
+        HANDLER(TYPE_ADD): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            CheckIntegers(lhs, rhs, "summing integer and non-integer");
+
+            auto add = [](auto& a, const auto& b) { a += b; };
+
+            if (CanOverwrite(lhs)) {
+                *sp++ = CalculateInPlace(lhs.Big(), rhs, add);
+            } else if (CanOverwrite(rhs)) {
+                *sp++ = CalculateInPlace(rhs.Big(), lhs, add);
+            } else {
+                *sp++ = Temporary(Calculate(_heap, lhs, rhs,
+                                         [](const auto& a, const auto& b) { return a + b; }));
+            }
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_SUB): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            CheckIntegers(lhs, rhs, "substracting integer and non-integer");
+
+            if (CanOverwrite(lhs)) {
+                *sp++ = CalculateInPlace(lhs.Big(), rhs,
+                    [](auto& a, const auto& b) { a -= b; });
+            } else {
+                *sp++ = Temporary(Calculate(_heap, lhs, rhs,
+                                         [](const auto& a, const auto& b) { return a - b; }));
+            }
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_MUL): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            CheckIntegers(lhs, rhs, "multiplying integer and non-integer");
+
+            auto multiply = [](auto& a, const auto& b) { a *= b; };
+
+            if (CanOverwrite(lhs)) {
+                *sp++ = CalculateInPlace(lhs.Big(), rhs, multiply);
+            } else if (CanOverwrite(rhs)) {
+                *sp++ = CalculateInPlace(rhs.Big(), lhs, multiply);
+            } else {
+                *sp++ = Temporary(Calculate(_heap, lhs, rhs,
+                                         [](const auto& a, const auto& b) { return a * b; }));
+            }
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_DIV): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            CheckIntegers(lhs, rhs, "dividing integer and non-integer");
+
+            *sp++ = Temporary(Calculate(_heap, lhs, rhs,
+                                     [](const auto& a, const auto& b) { return a / b; }));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_MOD): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            CheckIntegers(lhs, rhs, "taking remainder of integer and non-integer");
+
+            *sp++ = Temporary(Calculate(_heap, lhs, rhs,
+                                     [](const auto& a, const auto& b) { return a % b; }));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_NEG): {
+            VmValue value = sp[-1];
+            sp[-1] = Temporary(Negate(_heap, value));
+            Discard(value);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPEQ): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(Equals(lhs, rhs, "=="));
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPGE): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(Compare(lhs, rhs) >= 0);
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPGT): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(Compare(lhs, rhs) > 0);
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPLE): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(Compare(lhs, rhs) <= 0);
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPLT): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(Compare(lhs, rhs) < 0);
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_COMPNE): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(!Equals(lhs, rhs, "!="));
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_BIN_AND): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(IsTruthy(lhs) && IsTruthy(rhs));
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_BIN_OR): {
+            VmValue rhs = *--sp;
+
+            VmValue lhs = *--sp;
+
+            int result = static_cast<int>(IsTruthy(lhs) || IsTruthy(rhs));
+
+            *sp++ = Temporary(VmValue(result));
+
+            DiscardOperands(sp[-1], lhs, rhs);
+
+            NEXT();
+        }
+        HANDLER(TYPE_JMP): {
+            currentInstruction = code->arguments[0];
+
+            NEXT();
+        }
+        HANDLER(TYPE_JZ): {
+            VmValue condition = *--sp;
+
+            // jz jumps if the top of the stack is 0
+            if (!IsTruthy(condition)) {
+                currentInstruction = code->arguments[0];
+            }
+
+            Discard(condition);
+
+            NEXT();
+        }
+        HANDLER(TYPE_JZ_CHECKED): {
+            VmValue condition = *--sp;
 
-            break;
+            if (!condition.IsInteger()) {
+                throw std::runtime_error(
+                    "jz cannot check because top of the stack is not "
+                    "integer");
+            }
+
+            if (!IsTruthy(condition)) {
+                currentInstruction = code->arguments[0];
+            }
+
+            Discard(condition);
+
+            NEXT();
         }
-        case TYPE_ACCESS: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error("access needs 1 argument");
+        HANDLER(TYPE_CALL): {
+            sp = ReserveStack(sp, code->arguments[2]);
+            PushFrame(code->arguments[1], currentInstruction);
+            currentInstruction = code->arguments[0];
+            frame = &_frames.back();
+            locals = _locals.data() + frame->base;
+
+            NEXT();
+        }
+        HANDLER(TYPE_RETURN): {
+            // If returnAddress is -1, then we are returning from the
+            // entrypoint. Therefore, end the program.
+            if (frame->returnAddress == -1) {
+                return;
+            }
+
+            // Returned values stay on the operand stack, which keeps them
+            // alive. Everything else of the frame is left to the collector.
+            if (int missing = code->arguments[1] - code->arguments[0]) {
+                VmValue* returned = sp - code->arguments[0];
+
+                std::move_backward(returned, sp, sp + missing);
+                std::fill_n(returned, missing, VmValue(int64_t(0)));
+                sp += missing;
             }
 
-            if (_values.empty()) {
+            currentInstruction = frame->returnAddress;
+            _locals.resize(frame->base);
+            _frames.pop_back();
+            frame = &_frames.back();
+            locals = _locals.data() + frame->base;
+
+            NEXT();
+        }
+        HANDLER(TYPE_ARRAY): {
+            VmValue arraySize = *--sp;
+
+            if (!arraySize.IsInteger()) {
                 throw std::runtime_error(
-                    "value stack is empty, no index for accessing");
+                    "provided array size is not integer");
             }
 
-            const std::string& arg = instruction.arguments[0];
-            std::shared_ptr<VmNode> arrayIndexNode = _values.back().lock();
+            if (Compare(arraySize, VmValue(int64_t(ARRAY_SIZE_LIMIT))) > 0) {
+                throw std::runtime_error("provided array size is too big");
+            }
+
+            if (Compare(arraySize, VmValue(int64_t(0))) < 0) {
+                throw std::runtime_error("provided array size is negative");
+            }
 
-            _values.pop_back();
+            size_t integerSize = arraySize.Small();
 
-            if (arrayIndexNode->GetNodeType() != NODE_TYPE_INTEGER) {
+            locals[code->arguments[0]] =
+                VmValue(_heap.Allocate<ArrayNode>(integerSize));
+            Discard(arraySize);
+
+            NEXT();
+        }
+        HANDLER(TYPE_ACCESS): {
+            VmValue arrayIndex = *--sp;
+
+            if (!arrayIndex.IsInteger()) {
                 throw std::runtime_error(
                     "provided array index is not integer");
             }
 
-            BigInteger arrayIndex = std::static_pointer_cast<IntegerNode>(arrayIndexNode)
-                                        ->RealValue();
+            *sp++ = GetArray(*frame, code->arguments[0])->Get(arrayIndex);
+            Discard(arrayIndex);
+
+            NEXT();
+        }
+        HANDLER(TYPE_SLICE): {
+            VmValue end = *--sp;
+            VmValue begin = *--sp;
+
+            ArrayNode* array = GetArray(*frame, code->arguments[0]);
+            size_t first = array->ConvertBoundToSizeT(begin);
+            size_t last = array->ConvertBoundToSizeT(end);
+
+            if (first > last) {
+                throw std::runtime_error("slice ends before it begins");
+            }
+
+            *sp++ =
+                VmValue(_heap.Allocate<ArrayNode>(array, first, last - first));
+
+            NEXT();
+        }
+        HANDLER(TYPE_LENGTH): {
+            const VmValue& variable = locals[code->arguments[0]];
+
+            if (!variable.IsArray()) {
+                throw std::runtime_error(
+                    "cannot get length of non-array type");
+            }
+
+            int64_t size = variable.Array()->Size();
 
-            std::shared_ptr<ArrayNode> arrayNode = std::static_pointer_cast<ArrayNode>(
-                frame.variables[arg].lock());
+            *sp++ = Temporary(VmValue(size));
 
-            _values.push_back(arrayNode->Get(arrayIndex));
+            NEXT();
+        }
+        HANDLER(TYPE_RECORD): {
+            locals[code->arguments[0]] =
+                VmValue(_heap.AllocateRecord(_recordLayouts[code->arguments[1]]));
 
-            break;
+            NEXT();
         }
-        case TYPE_LENGTH: {
-            if (instruction.arguments.size() != 1) {
-                throw std::runtime_error("length needs 1 argument");
+        HANDLER(TYPE_GET_FIELD): {
+            *sp++ = GetField(*frame, *code);
+
+            NEXT();
+        }
+        HANDLER(TYPE_SET_FIELD): {
+            VmValue& field = GetField(*frame, *code);
+            VmValue value = *--sp;
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
             }
 
-            const std::string& arg = instruction.arguments[0];
+            field = value;
+
+            if (!value.IsSmall()) {
+                _heap.RecordWrite(field);
+            }
+
+            NEXT();
+        }
+        HANDLER(TYPE_END): {
+            return;
+        }
+#ifndef EWLANG_THREADED_DISPATCH
+        }
+    }
+#endif
+}
+
+// Result of a register instruction. The registers past the variables stand
+// for the operand stack, only they may hold temporaries.
+void StoreResult(VmValue& target, VmValue value, bool temporary)
+{
+    if (VmNode* node = value.Node()) {
+        node->SetTemporary(temporary);
+    }
+
+    target = value;
+}
+
+// The registers hold every live value, there is no operand stack.
+#undef FETCH
+#define FETCH()                                       \
+    do {                                              \
+        if (_heap.ShouldCollect()) {                  \
+            CollectGarbage(_values.data());           \
+        }                                             \
+                                                      \
+        code = &_registerCode[currentInstruction++];  \
+    } while (false)
+
+// Register VM counterpart of Discard() for a value in a stack register that
+// an instruction has read, unless it became the result the instruction
+// writes. The register is cleared so that the collector neither finds the
+// freed node nor keeps a dropped array or record alive.
+void VirtualMachine::DiscardRegister(VmValue& value, const VmValue* result)
+{
+    if (result == nullptr || value.Node() != result->Node()) {
+        Discard(value);
+    }
+
+    value = VmValue::Undefined();
+}
+
+// Same handlers as Execute(), on registers.
+void VirtualMachine::ExecuteRegisters()
+{
+    size_t currentInstruction = _registerEntry;
+    const RegisterCode* code = nullptr;
+
+    PushFrame(0, -1);
+
+    // Registers from variables on are temporary ones.
+    Frame* frame = &_frames.back();
+    VmValue* registers = _locals.data() + frame->base;
+    int variables = _functions[0].variables.size();
+
+    // Stack registers that an instruction reads are popped in the bytecode,
+    // before it writes its result, which may be the value of one of them.
+    // Small integers need nothing, they are left where they are.
+    auto pop = [&registers, &variables, this](
+                   int operand, const VmValue* result = nullptr) {
+        if (operand >= variables && !registers[operand].IsSmall()) {
+            DiscardRegister(registers[operand], result);
+        }
+    };
+
+#ifdef EWLANG_THREADED_DISPATCH
+    // In the order of RegisterInstructionType.
+    static const void* const handlers[] = {
+        &&HANDLER_REGISTER_MOVE,
+        &&HANDLER_REGISTER_MOVE_CHECKED,
+        &&HANDLER_REGISTER_ADD,
+        &&HANDLER_REGISTER_SUB,
+        &&HANDLER_REGISTER_MUL,
+        &&HANDLER_REGISTER_DIV,
+        &&HANDLER_REGISTER_MOD,
+        &&HANDLER_REGISTER_COMPLT,
+        &&HANDLER_REGISTER_COMPGT,
+        &&HANDLER_REGISTER_COMPGE,
+        &&HANDLER_REGISTER_COMPLE,
+        &&HANDLER_REGISTER_COMPNE,
+        &&HANDLER_REGISTER_COMPEQ,
+        &&HANDLER_REGISTER_BIN_AND,
+        &&HANDLER_REGISTER_BIN_OR,
+        &&HANDLER_REGISTER_NEG,
+        &&HANDLER_REGISTER_PRINT,
+        &&HANDLER_REGISTER_JMP,
+        &&HANDLER_REGISTER_JZ,
+        &&HANDLER_REGISTER_JZ_CHECKED,
+        &&HANDLER_REGISTER_JZ_COMPLT,
+        &&HANDLER_REGISTER_JZ_COMPGT,
+        &&HANDLER_REGISTER_JZ_COMPGE,
+        &&HANDLER_REGISTER_JZ_COMPLE,
+        &&HANDLER_REGISTER_JZ_COMPNE,
+        &&HANDLER_REGISTER_JZ_COMPEQ,
+        &&HANDLER_REGISTER_CALL,
+        &&HANDLER_REGISTER_RETURN,
+        &&HANDLER_REGISTER_ARRAY,
+        &&HANDLER_REGISTER_ACCESS,
+        &&HANDLER_REGISTER_SET_ELEMENT,
+        &&HANDLER_REGISTER_LENGTH,
+        &&HANDLER_REGISTER_SLICE,
+        &&HANDLER_REGISTER_RECORD,
+        &&HANDLER_REGISTER_GET_FIELD,
+        &&HANDLER_REGISTER_SET_FIELD,
+        &&HANDLER_REGISTER_CLEAR,
+        &&HANDLER_REGISTER_END,
+    };
+
+    static_assert(std::size(handlers) == REGISTER_END + 1);
+
+    NEXT();
+#else
+    while (true) {
+        FETCH();
+
+        switch (code->type) {
+#endif
+        HANDLER(REGISTER_MOVE): {
+            VmValue value = GetOperand(*frame, code->arguments[1]);
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
+            }
+
+            pop(code->arguments[1], &value);
+            registers[code->arguments[0]] = value;
+
+            NEXT();
+        }
+        HANDLER(REGISTER_MOVE_CHECKED): {
+            // Only pushes of a variable, whose value is never a temporary.
+            registers[code->arguments[0]] =
+                GetVariable(*frame, code->arguments[1]);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_ADD): {
+            const auto [target, first, second] = code->arguments;
+            const VmValue& lhs = GetOperand(*frame, first);
+            const VmValue& rhs = GetOperand(*frame, second);
+
+            CheckIntegers(lhs, rhs, "summing integer and non-integer");
+
+            auto add = [](auto& a, const auto& b) { a += b; };
+            VmValue result;
+
+            if (CanOverwrite(lhs)) {
+                result = CalculateInPlace(lhs.Big(), rhs, add);
+            } else if (CanOverwrite(rhs)) {
+                result = CalculateInPlace(rhs.Big(), lhs, add);
+            } else {
+                result = Calculate(_heap, lhs, rhs,
+                    [](const auto& a, const auto& b) { return a + b; });
+            }
+
+            pop(first, &result);
+            pop(second, &result);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_SUB): {
+            const auto [target, first, second] = code->arguments;
+            const VmValue& lhs = GetOperand(*frame, first);
+            const VmValue& rhs = GetOperand(*frame, second);
+
+            CheckIntegers(lhs, rhs, "substracting integer and non-integer");
+
+            VmValue result;
+
+            if (CanOverwrite(lhs)) {
+                result = CalculateInPlace(lhs.Big(), rhs,
+                    [](auto& a, const auto& b) { a -= b; });
+            } else {
+                result = Calculate(_heap, lhs, rhs,
+                    [](const auto& a, const auto& b) { return a - b; });
+            }
+
+            pop(first, &result);
+            pop(second, &result);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_MUL): {
+            const auto [target, first, second] = code->arguments;
+            const VmValue& lhs = GetOperand(*frame, first);
+            const VmValue& rhs = GetOperand(*frame, second);
+
+            CheckIntegers(lhs, rhs, "multiplying integer and non-integer");
+
+            auto multiply = [](auto& a, const auto& b) { a *= b; };
+            VmValue result;
+
+            if (CanOverwrite(lhs)) {
+                result = CalculateInPlace(lhs.Big(), rhs, multiply);
+            } else if (CanOverwrite(rhs)) {
+                result = CalculateInPlace(rhs.Big(), lhs, multiply);
+            } else {
+                result = Calculate(_heap, lhs, rhs,
+                    [](const auto& a, const auto& b) { return a * b; });
+            }
+
+            pop(first, &result);
+            pop(second, &result);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_DIV): {
+            const auto [target, first, second] = code->arguments;
+            const VmValue& lhs = GetOperand(*frame, first);
+            const VmValue& rhs = GetOperand(*frame, second);
+
+            CheckIntegers(lhs, rhs, "dividing integer and non-integer");
+
+            VmValue result = Calculate(_heap, lhs, rhs,
+                [](const auto& a, const auto& b) { return a / b; });
+
+            pop(first);
+            pop(second);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_MOD): {
+            const auto [target, first, second] = code->arguments;
+            const VmValue& lhs = GetOperand(*frame, first);
+            const VmValue& rhs = GetOperand(*frame, second);
+
+            CheckIntegers(lhs, rhs, "taking remainder of integer and non-integer");
+
+            VmValue result = Calculate(_heap, lhs, rhs,
+                [](const auto& a, const auto& b) { return a % b; });
+
+            pop(first);
+            pop(second);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_NEG): {
+            const auto [target, operand, unused] = code->arguments;
+
+            VmValue result = Negate(_heap, GetOperand(*frame, operand));
+
+            pop(operand);
+            StoreResult(registers[target], result, target >= variables);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPEQ): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = Equals(left, right, "==");
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPGE): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = Compare(left, right) >= 0;
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPGT): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = Compare(left, right) > 0;
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPLE): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = Compare(left, right) <= 0;
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPLT): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = Compare(left, right) < 0;
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_COMPNE): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = !Equals(left, right, "!=");
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_BIN_AND): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = IsTruthy(left) && IsTruthy(right);
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_BIN_OR): {
+            const auto [target, lhs, rhs] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            int64_t result = IsTruthy(left) || IsTruthy(right);
+
+            pop(lhs);
+            pop(rhs);
+            registers[target] = VmValue(result);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_PRINT): {
+            GetOperand(*frame, code->arguments[0]).Print(std::cout);
+            std::cout << "\n";
+            pop(code->arguments[0]);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JMP): {
+            currentInstruction = code->arguments[0];
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ): {
+            if (!IsTruthy(GetOperand(*frame, code->arguments[0]))) {
+                currentInstruction = code->arguments[1];
+            }
+
+            pop(code->arguments[0]);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_CHECKED): {
+            const VmValue& condition = GetOperand(*frame, code->arguments[0]);
+
+            if (!condition.IsInteger()) {
+                throw std::runtime_error(
+                    "jz cannot check because top of the stack is not "
+                    "integer");
+            }
+
+            if (!IsTruthy(condition)) {
+                currentInstruction = code->arguments[1];
+            }
+
+            pop(code->arguments[0]);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPEQ): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (!Equals(left, right, "==")) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPGE): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (Compare(left, right) < 0) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPGT): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (Compare(left, right) <= 0) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPLE): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (Compare(left, right) > 0) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPLT): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (Compare(left, right) >= 0) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_JZ_COMPNE): {
+            const auto [lhs, rhs, target] = code->arguments;
+            const VmValue& left = GetOperand(*frame, lhs);
+            const VmValue& right = GetOperand(*frame, rhs);
+
+            if (Equals(left, right, "!=")) {
+                currentInstruction = target;
+            }
+
+            pop(lhs);
+            pop(rhs);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_CALL): {
+            const auto [target, function, first] = code->arguments;
+            const Function& callee = _functions[function];
+            size_t arguments = frame->base + first;
+
+            PushFrame(function, currentInstruction);
+            currentInstruction = target;
+            frame = &_frames.back();
+            frame->arguments = arguments;
+            registers = _locals.data() + frame->base;
+            variables = callee.variables.size();
+
+            // The values the callee pops become its first stack registers,
+            // and are gone from the caller's until the results come back.
+            VmValue* popped = _locals.data() + arguments;
+
+            std::copy_n(popped, -callee.lowest, registers + variables);
+            std::fill_n(popped, -callee.lowest, VmValue::Undefined());
+
+            NEXT();
+        }
+        HANDLER(REGISTER_RETURN): {
+            // If returnAddress is -1, then we are returning from the
+            // entrypoint. Therefore, end the program.
+            if (frame->returnAddress == -1) {
+                return;
+            }
+
+            // What is left on the callee's part of the stack goes back to
+            // the caller's, as in Execute(), with the zeros for missing
+            // results below the returned values.
+            const auto [count, missing, unused] = code->arguments;
+            const Function& callee = _functions[frame->function];
+            size_t below = callee.returned - callee.lowest - count - missing;
+            VmValue* results = _locals.data() + frame->arguments;
+
+            std::copy_n(registers + variables, below, results);
+            std::fill_n(results + below, missing, VmValue(int64_t(0)));
+            std::copy_n(registers + variables + below, count,
+                results + below + missing);
+
+            currentInstruction = frame->returnAddress;
+            _locals.resize(frame->base);
+            _frames.pop_back();
+            frame = &_frames.back();
+            registers = _locals.data() + frame->base;
+            variables = _functions[frame->function].variables.size();
+
+            NEXT();
+        }
+        HANDLER(REGISTER_ARRAY): {
+            const VmValue& arraySize = GetOperand(*frame, code->arguments[1]);
+
+            if (!arraySize.IsInteger()) {
+                throw std::runtime_error(
+                    "provided array size is not integer");
+            }
+
+            if (Compare(arraySize, VmValue(int64_t(ARRAY_SIZE_LIMIT))) > 0) {
+                throw std::runtime_error("provided array size is too big");
+            }
+
+            if (Compare(arraySize, VmValue(int64_t(0))) < 0) {
+                throw std::runtime_error("provided array size is negative");
+            }
+
+            size_t integerSize = arraySize.Small();
+
+            registers[code->arguments[0]] =
+                VmValue(_heap.Allocate<ArrayNode>(integerSize));
+            pop(code->arguments[1]);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_ACCESS): {
+            const auto [target, array, index] = code->arguments;
+            const VmValue& arrayIndex = GetOperand(*frame, index);
+
+            if (!arrayIndex.IsInteger()) {
+                throw std::runtime_error(
+                    "provided array index is not integer");
+            }
+
+            VmValue element = GetArray(*frame, array)->Get(arrayIndex);
+
+            pop(index);
+            registers[target] = element;
+
+            NEXT();
+        }
+        HANDLER(REGISTER_SET_ELEMENT): {
+            const auto [variable, index, source] = code->arguments;
+
+            // The value is pushed before the index, so it is read first.
+            VmValue value = GetOperand(*frame, source);
+            const VmValue& arrayIndex = GetOperand(*frame, index);
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
+            }
+
+            ArrayNode* array = GetArray(*frame, variable);
+            size_t position = array->ConvertIndexToSizeT(arrayIndex);
+
+            if (size_t backed = array->Set(position, value)) {
+                _heap.AddBytes(backed);
+            }
+
+            if (!value.IsSmall()) {
+                _heap.RecordWrite(array->Cell(position));
+            }
+
+            pop(index);
+            pop(source);
+
+            NEXT();
+        }
+        HANDLER(REGISTER_SLICE): {
+            const auto [target, variable, bounds] = code->arguments;
+
+            ArrayNode* array = GetArray(*frame, variable);
+            size_t first = array->ConvertBoundToSizeT(registers[bounds]);
+            size_t last = array->ConvertBoundToSizeT(registers[bounds + 1]);
+
+            if (first > last) {
+                throw std::runtime_error("slice ends before it begins");
+            }
+
+            pop(bounds);
+            pop(bounds + 1);
+            registers[target] =
+                VmValue(_heap.Allocate<ArrayNode>(array, first, last - first));
 
-            std::shared_ptr<VmNode> node = frame.variables[arg].lock();
+            NEXT();
+        }
+        HANDLER(REGISTER_LENGTH): {
+            const VmValue& variable = registers[code->arguments[1]];
 
-            if (node->GetNodeType() != NODE_TYPE_ARRAY) {
+            if (!variable.IsArray()) {
                 throw std::runtime_error(
                     "cannot get length of non-array type");
             }
 
-            std::shared_ptr<ArrayNode> arrayNode = std::static_pointer_cast<ArrayNode>(node);
+            int64_t size = variable.Array()->Size();
 
-            frame.objects.push_back(
-                std::make_shared<IntegerNode>(arrayNode->Size()));
+            registers[code->arguments[0]] = VmValue(size);
 
-            _values.push_back(frame.objects.back());
+            NEXT();
+        }
+        HANDLER(REGISTER_RECORD): {
+            registers[code->arguments[0]] =
+                VmValue(_heap.AllocateRecord(_recordLayouts[code->arguments[1]]));
 
-            break;
+            NEXT();
         }
-        default: {
-            throw std::runtime_error("caught unknown instruction: " + std::to_string(instruction.type));
+        HANDLER(REGISTER_GET_FIELD): {
+            registers[code->arguments[0]] =
+                GetField(*frame, _code[code->arguments[1]]);
+
+            NEXT();
         }
+        HANDLER(REGISTER_SET_FIELD): {
+            VmValue value = GetOperand(*frame, code->arguments[0]);
+            VmValue& field = GetField(*frame, _code[code->arguments[1]]);
+
+            if (VmNode* node = value.Node()) {
+                node->SetTemporary(false);
+            }
+
+            field = value;
+
+            if (!value.IsSmall()) {
+                _heap.RecordWrite(field);
+            }
+
+            pop(code->arguments[0]);
+
+            NEXT();
         }
+        HANDLER(REGISTER_CLEAR): {
+            const auto [first, count, unused] = code->arguments;
 
-        ++currentInstruction;
+            for (int i = 0; i < count; ++i) {
+                pop(first + i);
+            }
 
-        /*for (const auto& [name, value] : frame.variables) {*/
-        /*    std::cout << name << " " << value.use_count() << "\n";*/
-        /*}*/
-        /*std::cout << "==========\n";*/
+            NEXT();
+        }
+        HANDLER(REGISTER_END): {
+            return;
+        }
+#ifndef EWLANG_THREADED_DISPATCH
+        }
     }
+#endif
 }
+
+#undef FETCH
+#undef HANDLER
+#undef NEXT
@@ -1,41 +1,150 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
 #include <map>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "heap.h"
+
 enum VmNodeType {
     NODE_TYPE_INTEGER,
     NODE_TYPE_ARRAY,
+    NODE_TYPE_RECORD,
 };
 
+class IntegerNode;
+class ArrayNode;
+class RecordNode;
+
+// Heap part of a VM value: integers that do not fit into int64_t, arrays and
+// records.
+// Nodes are owned by the Heap and freed by its collector. They are not
+// polymorphic, the VM switches on the node type instead, and so does the Heap
+// when it destroys them.
 class VmNode {
 public:
-    virtual ~VmNode() = default;
+    explicit VmNode(VmNodeType type) : _type(type) {}
+
+protected:
+    // Not virtual, nodes are deleted as their own type.
+    ~VmNode() = default;
+
+public:
+    VmNodeType GetNodeType() const { return _type; }
+
+    // Temporaries are results that are referenced only by the operand stack.
+    // Once popped nothing else can observe them, so they can be overwritten,
+    // or freed without waiting for a collection.
+    bool IsTemporary() const { return _temporary; }
+    void SetTemporary(bool temporary) { _temporary = temporary; }
+
+    // Reachable in the collection that is running.
+    bool IsMarked() const { return _marked; }
+    void SetMarked(bool marked) { _marked = marked; }
+
+    // Position in the heap's list of old nodes, so that it can be freed
+    // without a search.
+    size_t GetHeapIndex() const { return _heapIndex; }
+    void SetHeapIndex(size_t index) { _heapIndex = index; }
+
+    // Young nodes live in the nursery. They count the scavenges they have
+    // survived, and the copy made by the running one is left behind in them.
+    bool IsYoung() const { return _young; }
+    void SetYoung(bool young) { _young = young; }
+
+    size_t GetAge() const { return _age; }
+    void SetAge(size_t age) { _age = static_cast<uint8_t>(age); }
+
+    VmNode* GetForwarded() const { return _forwarded; }
+    void SetForwarded(VmNode* node) { _forwarded = node; }
+
+private:
+    VmNodeType _type;
+    bool _temporary = false;
+    bool _marked = false;
+    bool _young = false;
+    uint8_t _age = 0;
+    size_t _heapIndex = 0;
+    VmNode* _forwarded = nullptr;
+};
+
+enum VmValueType : uint8_t {
+    // Zero so that zero-filled memory holds integer zeros.
+    VALUE_TYPE_SMALL_INTEGER = 0,
+    VALUE_TYPE_BIG_INTEGER,
+    VALUE_TYPE_ARRAY,
+    VALUE_TYPE_RECORD,
+
+    // Local slot that has not been assigned yet. Never leaves the slot.
+    VALUE_TYPE_UNDEFINED,
+};
 
+// Value on the operand stack, in a variable, an array cell or a record field. Integers
+// fitting into int64_t are stored inline, everything else points to a node.
+// Big integers are never in the int64_t range, so every integer has exactly
+// one representation.
+class VmValue {
 public:
-    virtual VmNodeType GetNodeType() const = 0;
-    virtual std::string Value() const = 0;
-    virtual std::shared_ptr<VmNode> Negate() = 0;
+    VmValue() : _small(0), _type(VALUE_TYPE_SMALL_INTEGER) {}
+
+    VmValue(int64_t value) : _small(value), _type(VALUE_TYPE_SMALL_INTEGER) {}
+
+    explicit VmValue(IntegerNode* node)
+        : _big(node), _type(VALUE_TYPE_BIG_INTEGER) {}
+
+    explicit VmValue(ArrayNode* node) : _array(node), _type(VALUE_TYPE_ARRAY) {}
+
+    explicit VmValue(RecordNode* node)
+        : _record(node), _type(VALUE_TYPE_RECORD) {}
 
 public:
-    virtual std::shared_ptr<VmNode> operator+(const VmNode& other) const = 0;
-    virtual std::shared_ptr<VmNode> operator-(const VmNode& other) const = 0;
-    virtual std::shared_ptr<VmNode> operator*(const VmNode& other) const = 0;
-    virtual std::shared_ptr<VmNode> operator/(const VmNode& other) const = 0;
-    virtual std::shared_ptr<VmNode> operator%(const VmNode& other) const = 0;
+    static VmValue Undefined()
+    {
+        VmValue value;
+        value._type = VALUE_TYPE_UNDEFINED;
+
+        return value;
+    }
 
 public:
-    virtual bool operator<(const VmNode& other) const = 0;
-    virtual bool operator>(const VmNode& other) const = 0;
-    virtual bool operator<=(const VmNode& other) const = 0;
-    virtual bool operator>=(const VmNode& other) const = 0;
-    virtual bool operator!=(const VmNode& other) const = 0;
-    virtual bool operator==(const VmNode& other) const = 0;
+    VmValueType GetType() const { return _type; }
+
+    bool IsSmall() const { return _type == VALUE_TYPE_SMALL_INTEGER; }
+    bool IsInteger() const { return _type <= VALUE_TYPE_BIG_INTEGER; }
+    bool IsArray() const { return _type == VALUE_TYPE_ARRAY; }
+    bool IsRecord() const { return _type == VALUE_TYPE_RECORD; }
+
+    int64_t Small() const { return _small; }
+    IntegerNode* Big() const { return _big; }
+    ArrayNode* Array() const { return _array; }
+    RecordNode* Record() const { return _record; }
+
+    // Node behind the value, nullptr for small integers.
+    VmNode* Node() const;
+
+    void Print(std::ostream& stream) const;
+
+private:
+    union {
+        int64_t _small;
+        IntegerNode* _big;
+        ArrayNode* _array;
+        RecordNode* _record;
+    };
+
+    VmValueType _type;
 };
 
+static_assert(std::is_trivially_copyable_v<VmValue>,
+    "arrays keep VmValue in zero-filled memory without constructing it");
+
 enum VmInstructionType {
     TYPE_PUSH = 0,
     TYPE_POP,
@@ -61,37 +170,260 @@ enum VmInstructionType {
     TYPE_LENGTH,
     TYPE_BIN_AND,
     TYPE_BIN_OR,
+    TYPE_RECORD,
+    TYPE_GET_FIELD,
+    TYPE_SET_FIELD,
+    TYPE_SLICE,
+    TYPE_DISCARD,
+
+    // Only in lowered code: a push from the constant pool and a store into an
+    // array cell, which are a push and a pop in the text form, and the end of
+    // the program.
+    TYPE_PUSH_CONSTANT,
+    TYPE_POP_ELEMENT,
+
+    // Push and jz that check what Verify() could not prove: that the
+    // variable is assigned, and that the condition is an integer.
+    TYPE_PUSH_CHECKED,
+    TYPE_JZ_CHECKED,
+    TYPE_END,
+};
+
+// Field names of a record type, in the order they are stored. The compiler
+// gives a field name the same position in every record that declares it, so
+// an access is compiled to a fixed offset and the VM only has to check that
+// the record really has that field there.
+struct RecordLayout {
+    std::string name;
+    std::vector<std::string> fields;
+
+    // Interned field names, see Instruction::fieldName.
+    std::vector<int> fieldNames;
 };
 
 struct Instruction {
     VmInstructionType type;
     std::vector<std::string> arguments;
 
+    // Index into the constant pool for pushes of literals, -1 otherwise.
+    int constant = -1;
+
+    // Resolved at load time: the layout created by record, and the offset
+    // and interned name of the field read or written by getField/setField.
+    const RecordLayout* layout = nullptr;
+    int fieldOffset = -1;
+    int fieldName = -1;
+
     Instruction& fromString(const std::string& instruction);
 };
 
-struct Frame {
-    // Variables are containing only weak pointer to objects on current frame.
-    // This will break all cyclic dependencies and ARC will work correctly.
-    std::unordered_map<std::string, std::weak_ptr<VmNode>> variables;
+// Instruction as it is executed, lowered from the text form at load time.
+// Every operand is resolved to an integer, so running it involves no
+// strings:
+// - push, pushChecked, pop, array, access, length, slice: slot of the
+//   variable;
+// - pushConstant: constant pool index;
+// - jmp, jz, jzChecked: index of the target instruction;
+// - call: index of the target instruction, index of the function, its
+//   maxStack;
+// - return: number of returned values, most values any return of the
+//   function gives back. Missing ones are zeros, put below the others;
+// - discard: number of values dropped;
+// - record: slot of the variable, layout index;
+// - getField, setField: slot of the variable, field offset, interned field
+//   name. The offset is only a guess, -1 if there is none, which GetField()
+//   replaces with the one of the last record accessed.
+struct Bytecode {
+    VmInstructionType type;
+    int32_t arguments[3] = {};
+};
+
+static_assert(sizeof(Bytecode) == 16, "bytecode should stay compact");
+
+enum RegisterInstructionType {
+    REGISTER_MOVE = 0,
+    REGISTER_MOVE_CHECKED,
+    REGISTER_ADD,
+    REGISTER_SUB,
+    REGISTER_MUL,
+    REGISTER_DIV,
+    REGISTER_MOD,
+    REGISTER_COMPLT,
+    REGISTER_COMPGT,
+    REGISTER_COMPGE,
+    REGISTER_COMPLE,
+    REGISTER_COMPNE,
+    REGISTER_COMPEQ,
+    REGISTER_BIN_AND,
+    REGISTER_BIN_OR,
+    REGISTER_NEG,
+    REGISTER_PRINT,
+    REGISTER_JMP,
+    REGISTER_JZ,
+    REGISTER_JZ_CHECKED,
+    REGISTER_JZ_COMPLT,
+    REGISTER_JZ_COMPGT,
+    REGISTER_JZ_COMPGE,
+    REGISTER_JZ_COMPLE,
+    REGISTER_JZ_COMPNE,
+    REGISTER_JZ_COMPEQ,
+    REGISTER_CALL,
+    REGISTER_RETURN,
+    REGISTER_ARRAY,
+    REGISTER_ACCESS,
+    REGISTER_SET_ELEMENT,
+    REGISTER_LENGTH,
+    REGISTER_SLICE,
+    REGISTER_RECORD,
+    REGISTER_GET_FIELD,
+    REGISTER_SET_FIELD,
+    REGISTER_CLEAR,
+    REGISTER_END,
+};
 
-    std::vector<std::shared_ptr<VmNode>> objects;
+// Three-address form of the bytecode, run by ExecuteRegisters() when the VM
+// is created with VM_REGISTER. A frame has a register for each variable,
+// numbered as in the bytecode, followed by one for each operand stack
+// position the function uses. Operands that read a value may also be
+// constants, encoded as -1 - index into the constant pool. Arguments:
+// - move: target, source; moveChecked: the same, from a variable that may
+//   not be assigned;
+// - add to binOR: target, lhs, rhs; neg: target, operand;
+// - print: operand; jmp: target instruction;
+// - jz, jzChecked: condition, target instruction; jz with a comparison:
+//   jumps to the third argument unless the comparison of the first two
+//   holds;
+// - call: target instruction, index of the function, first register of the
+//   caller's values that the callee pops, where its results are put back;
+// - array: variable, size; access: target, variable, index;
+//   setElement: variable, index, value; length: target, variable;
+// - slice: target, variable, register of the bounds, which are consecutive;
+// - record: variable, layout index;
+// - return: number of returned values, number of zeros put below them;
+// - getField: target, index of the getField bytecode; setField: value,
+//   index of the setField bytecode;
+// - clear: first register, number of registers. The values of a discard,
+//   which are freed if temporary.
+struct RegisterCode {
+    RegisterInstructionType type;
+    int32_t arguments[3] = {};
+};
+
+static_assert(sizeof(RegisterCode) == 16, "bytecode should stay compact");
+
+// Bytecode a VirtualMachine executes.
+enum VmKind {
+    VM_STACK,
+    VM_REGISTER,
+};
+
+// Function found by Lower(). Its variables are numbered in the order they
+// appear, and a call gives it slots consecutive local slots.
+struct Function {
+    std::string name;
+    std::vector<std::string> variables;
+
+    // Operand stack use found by Verify(): the most values it has on the
+    // stack at once and, relative to the depth at the call, the lowest depth
+    // it pops to and the depth it returns at.
+    size_t maxStack = 0;
+    int lowest = 0;
+    int returned = 0;
+
+    // Local slots of a frame: its variables, and in the register VM a
+    // register for every operand stack position it uses after them.
+    size_t slots = 0;
+};
 
+struct Frame {
+    // Slots of the frame start at _locals[base].
+    size_t base = 0;
+    int function = 0;
     int returnAddress = -1;
+
+    // Register VM: the first of the caller's registers that the arguments
+    // were taken from, results are put back there.
+    size_t arguments = 0;
 };
 
 class VirtualMachine {
+public:
+    explicit VirtualMachine(
+        HeapOptions heapOptions = {}, VmKind kind = VM_STACK);
+
 public:
     void Run();
 
 private:
     void ReadInstructions();
     void Optimize();
+    void BuildConstantPool();
+    void ResolveRecords();
+    std::vector<int> FindFunctions();
+    void Lower();
+    void Verify();
+    void SelectChecks();
+    void LowerToRegisters();
     void Execute();
+    void ExecuteRegisters();
+
+    void PushFrame(int function, int returnAddress);
+
+    // Throws if the variable is not assigned.
+    VmValue& GetVariable(const Frame& frame, int slot);
+    ArrayNode* GetArray(const Frame& frame, int slot);
+    VmValue& GetField(const Frame& frame, Bytecode& code);
+
+    // Register or constant read by a register instruction.
+    const VmValue& GetOperand(const Frame& frame, int operand);
+
+    void Discard(const VmValue& value);
+    void DiscardRegister(VmValue& value, const VmValue* result);
+    void DiscardOperands(
+        const VmValue& pushed, const VmValue& lhs, const VmValue& rhs);
+
+    // Makes room for size more values above top, which may move the stack,
+    // and returns the new top.
+    VmValue* ReserveStack(VmValue* top, size_t size);
+
+    // Values on the operand stack are the ones below top.
+    void CollectGarbage(VmValue* top);
 
 private:
+    Heap _heap;
+    VmKind _kind;
     std::unordered_map<std::string, int> _marks;
     std::vector<Instruction> _instructions;
     std::vector<Frame> _frames;
-    std::vector<std::weak_ptr<VmNode>> _values;
+
+    // Operand stack. Its size is the room reserved so far, the used part is
+    // tracked by Execute().
+    std::vector<VmValue> _values;
+
+    // Variables of all frames, one slot each.
+    std::vector<VmValue> _locals;
+
+    // Literals parsed once at load time. Their nodes are never temporary, so
+    // nothing overwrites them in place.
+    std::vector<VmValue> _constants;
+
+    // Keyed by record name. Nodes point to their layout, so it must not move.
+    std::unordered_map<std::string, RecordLayout> _layouts;
+
+    // Lowered _instructions, with the same indices, and the names behind
+    // the integers in it, for error messages.
+    std::vector<Bytecode> _code;
+    std::vector<const RecordLayout*> _recordLayouts;
+    std::vector<Function> _functions;
+    std::vector<std::string> _fieldNames;
+
+    // Function of each instruction, found by Lower(), and the operand stack
+    // depth it runs at, found by Verify(). Code outside every function has
+    // owner -1, code that never runs has depth UNREACHED_DEPTH.
+    std::vector<int> _owners;
+    std::vector<int> _depths;
+
+    // Output of LowerToRegisters(), and the position of the entrypoint in it.
+    std::vector<RegisterCode> _registerCode;
+    size_t _registerEntry = 0;
 };
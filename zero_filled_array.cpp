@@ -0,0 +1,69 @@
+#include "zero_filled_array.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// From this size on blocks are mapped directly. calloc() may hand out
+// recycled memory that it has to clear first.
+constexpr size_t MIN_MAPPED_BYTES = 256 * 1024;
+
+} // namespace
+
+bool IsMappedZeroed(size_t bytes)
+{
+#ifdef __linux__
+    return bytes >= MIN_MAPPED_BYTES;
+#else
+    return false;
+#endif
+}
+
+void* AllocateZeroed(size_t bytes)
+{
+    if (bytes == 0) {
+        return nullptr;
+    }
+
+#ifdef __linux__
+    if (IsMappedZeroed(bytes)) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        return memory;
+    }
+#endif
+
+    void* memory = std::calloc(bytes, 1);
+
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void FreeZeroed(void* memory, size_t bytes)
+{
+    if (memory == nullptr) {
+        return;
+    }
+
+#ifdef __linux__
+    if (IsMappedZeroed(bytes)) {
+        munmap(memory, bytes);
+        return;
+    }
+#endif
+
+    std::free(memory);
+}
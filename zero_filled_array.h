@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Memory whose bytes are all zero, without touching it up front. Large blocks
+// are mapped straight from the OS, whose pages are zero-filled on first
+// access, so untouched parts cost neither time nor memory.
+void* AllocateZeroed(size_t bytes);
+
+void FreeZeroed(void* memory, size_t bytes);
+
+// Whether AllocateZeroed() maps a block of this size, rather than taking it
+// from calloc() which backs all of it.
+bool IsMappedZeroed(size_t bytes);
+
+// Fixed-size array whose elements start as all-zero bytes, created in O(1).
+// Elements are never constructed, so T has to be valid as zero bytes.
+//
+// Mapped arrays remember which chunks of CHUNK_BYTES have been written. Only
+// those count as backed, and only their elements are visited by
+// ForEachWritten(), the others are still zero.
+template <typename T>
+class ZeroFilledArray {
+    static_assert(std::is_trivially_copyable_v<T>
+        && std::is_trivially_destructible_v<T>);
+
+public:
+    static constexpr size_t CHUNK_BYTES = 64 * 1024;
+    static constexpr size_t CHUNK_ELEMENTS = CHUNK_BYTES / sizeof(T);
+
+public:
+    ZeroFilledArray() = default;
+
+    explicit ZeroFilledArray(size_t size)
+        : _data(static_cast<T*>(AllocateZeroed(size * sizeof(T))))
+        , _size(size)
+    {
+        if (IsMappedZeroed(size * sizeof(T))) {
+            _written = static_cast<bool*>(AllocateZeroed(Chunks()));
+        }
+    }
+
+    ZeroFilledArray(const ZeroFilledArray&) = delete;
+
+    ZeroFilledArray(ZeroFilledArray&& other) noexcept
+        : _data(std::exchange(other._data, nullptr))
+        , _size(std::exchange(other._size, 0))
+        , _written(std::exchange(other._written, nullptr))
+        , _writtenChunks(std::exchange(other._writtenChunks, 0))
+    {
+    }
+
+    ~ZeroFilledArray()
+    {
+        FreeZeroed(_written, _written != nullptr ? Chunks() : 0);
+        FreeZeroed(_data, _size * sizeof(T));
+    }
+
+public:
+    ZeroFilledArray& operator=(const ZeroFilledArray&) = delete;
+
+    ZeroFilledArray& operator=(ZeroFilledArray&& other) noexcept
+    {
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        std::swap(_written, other._written);
+        std::swap(_writtenChunks, other._writtenChunks);
+
+        return *this;
+    }
+
+public:
+    size_t size() const { return _size; }
+
+    const T& operator[](size_t index) const { return _data[index]; }
+
+    // Element for writing. Returns the bytes that became backed: CHUNK_BYTES
+    // when its chunk is written for the first time, 0 otherwise.
+    size_t Store(size_t index, const T& value)
+    {
+        _data[index] = value;
+        return MarkWritten(index);
+    }
+
+    // Reference to an element for writing in place.
+    T& Cell(size_t index)
+    {
+        MarkWritten(index);
+        return _data[index];
+    }
+
+    // Memory in use: all of a calloc()'ed array, the written chunks of a
+    // mapped one.
+    size_t BackedBytes() const
+    {
+        if (_written == nullptr) {
+            return _size * sizeof(T);
+        }
+
+        return Chunks() + std::min(_writtenChunks * CHUNK_BYTES, _size * sizeof(T));
+    }
+
+    // Calls the function with the index and value of every element in a
+    // written chunk.
+    template <typename Function>
+    void ForEachWritten(Function function) const
+    {
+        for (size_t chunk = 0; chunk < Chunks(); ++chunk) {
+            if (_written != nullptr && !_written[chunk]) {
+                continue;
+            }
+
+            size_t end = std::min(_size, (chunk + 1) * CHUNK_ELEMENTS);
+
+            for (size_t i = chunk * CHUNK_ELEMENTS; i < end; ++i) {
+                function(i, _data[i]);
+            }
+        }
+    }
+
+private:
+    size_t Chunks() const { return (_size + CHUNK_ELEMENTS - 1) / CHUNK_ELEMENTS; }
+
+    size_t MarkWritten(size_t index)
+    {
+        if (_written == nullptr || _written[index / CHUNK_ELEMENTS]) {
+            return 0;
+        }
+
+        _written[index / CHUNK_ELEMENTS] = true;
+        ++_writtenChunks;
+
+        return CHUNK_BYTES;
+    }
+
+private:
+    T* _data = nullptr;
+    size_t _size = 0;
+
+    // One flag per chunk, nullptr for arrays that are not mapped.
+    bool* _written = nullptr;
+    size_t _writtenChunks = 0;
+};